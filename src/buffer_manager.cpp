@@ -0,0 +1,87 @@
+#include "buffer_manager.h"
+#include <stdexcept>
+#include <unordered_set>
+
+BufferManager::BufferManager() : currentIndex(0), nextId(1) {
+    newBuffer();
+}
+
+size_t BufferManager::newBuffer() {
+    size_t id = nextId++;
+    buffers.push_back({id, "untitled", std::make_unique<TextEditor>()});
+    currentIndex = buffers.size() - 1;
+    return id;
+}
+
+size_t BufferManager::open(const std::string& filename) {
+    auto editor = std::make_unique<TextEditor>();
+    editor->loadFile(filename, interner);
+    size_t id = nextId++;
+    buffers.push_back({id, filename, std::move(editor)});
+    currentIndex = buffers.size() - 1;
+    return id;
+}
+
+void BufferManager::switchTo(size_t id) {
+    currentIndex = indexOf(id);
+}
+
+void BufferManager::close(size_t id) {
+    size_t index = indexOf(id);
+    buffers.erase(buffers.begin() + index);
+    if (buffers.empty()) {
+        newBuffer();
+    } else if (currentIndex >= index && currentIndex > 0) {
+        --currentIndex;
+    }
+}
+
+TextEditor& BufferManager::current() {
+    return *buffers[currentIndex].editor;
+}
+
+size_t BufferManager::currentId() const {
+    return buffers[currentIndex].id;
+}
+
+std::vector<BufferManager::BufferInfo> BufferManager::list() const {
+    std::vector<BufferInfo> result;
+    for (const auto& buffer : buffers) {
+        const Rope& rope = buffer.editor->getRope();
+        double attributed = 0;
+        rope.visitLeaves([&](const std::shared_ptr<Leaf>& leaf) {
+            if (leaf->isResident()) attributed += static_cast<double>(leaf->length()) / leaf.use_count();
+        });
+        result.push_back({buffer.id, buffer.name, rope.length(), rope.memoryUsage(),
+                          static_cast<size_t>(attributed + 0.5)});
+    }
+    return result;
+}
+
+BufferManager::Totals BufferManager::totals() const {
+    Totals totals = {buffers.size(), 0, 0, 0, 0};
+    std::unordered_set<const Leaf*> seen;
+    for (const auto& buffer : buffers) {
+        const Rope& rope = buffer.editor->getRope();
+        totals.documentBytes += rope.length();
+        totals.overheadBytes += rope.memoryUsage().nodeBytes;
+        rope.visitLeaves([&](const std::shared_ptr<Leaf>& leaf) {
+            if (!seen.insert(leaf.get()).second) return;
+            ++totals.leaves;
+            totals.overheadBytes += sizeof(Leaf);
+            if (leaf->isResident()) totals.storedBytes += leaf->length();
+        });
+    }
+    return totals;
+}
+
+LeafInternTable::Stats BufferManager::internStats() const {
+    return interner.stats();
+}
+
+size_t BufferManager::indexOf(size_t id) const {
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        if (buffers[i].id == id) return i;
+    }
+    throw std::out_of_range("No buffer with that id");
+}
@@ -0,0 +1,65 @@
+#ifndef BUFFER_MANAGER_H
+#define BUFFER_MANAGER_H
+
+#include "text_editor.h"
+#include "intern_table.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Holds every open document. Files opened through the manager share one
+// intern table, so chunks that are identical across buffers are stored once.
+class BufferManager {
+public:
+    struct BufferInfo {
+        size_t id;
+        std::string name;
+        size_t length;
+        Rope::MemoryUsage memory;
+        // Leaf bytes split evenly between the buffers that share each leaf;
+        // summed over all buffers this equals the text actually stored
+        size_t attributedBytes;
+    };
+
+    struct Totals {
+        size_t buffers;
+        size_t documentBytes;  // sum of the buffers' lengths
+        size_t storedBytes;    // distinct leaf text held in memory
+        size_t leaves;         // distinct leaves
+        size_t overheadBytes;  // tree nodes and leaf headers
+    };
+
+    BufferManager();
+
+    // Both return the id of the new buffer, which becomes the current one
+    size_t newBuffer();
+    size_t open(const std::string& filename);
+
+    void switchTo(size_t id);
+    // Closing the last buffer leaves an empty one behind
+    void close(size_t id);
+
+    TextEditor& current();
+    size_t currentId() const;
+
+    std::vector<BufferInfo> list() const;
+    Totals totals() const;
+    LeafInternTable::Stats internStats() const;
+
+private:
+    struct Buffer {
+        size_t id;
+        std::string name;
+        std::unique_ptr<TextEditor> editor;
+    };
+
+    LeafInternTable interner;
+    std::vector<Buffer> buffers;
+    size_t currentIndex;
+    size_t nextId;
+
+    size_t indexOf(size_t id) const;
+};
+
+#endif
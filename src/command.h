@@ -1,14 +0,0 @@
-#ifndef COMMAND_H
-
-#define COMMAND_H
-
-class TextEditor;
-
-class Command {
-public:
-    virtual ~Command() = default;
-    virtual void execute() = 0;
-    virtual void undo() = 0;
-};
-
-#endif
\ No newline at end of file
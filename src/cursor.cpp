@@ -4,48 +4,50 @@
 #include <iostream>
 
 
-Cursor::Cursor() : row(0), col(0), preferredCol(0) {}
+Cursor::Cursor(MarkSet& marks)
+    : marks(marks), mark(marks.create(0, MarkSet::Gravity::Right)), preferredCol(0) {}
+
+Cursor::~Cursor() {
+    marks.remove(mark);
+}
+
+size_t Cursor::getRow(const Rope& text) const {
+    return text.lineOf(getGlobalPosition());
+}
+
+size_t Cursor::getCol(const Rope& text) const {
+    return getGlobalPosition() - text.lineStart(getRow(text));
+}
 
-size_t Cursor::getRow() const { return row; }
-size_t Cursor::getCol() const { return col; }
 void Cursor::moveUp(const Rope& text) {
+    size_t row = getRow(text);
     if (row > 0) {
-        --row;
-        updateColPosition(text);
+        updateColPosition(text, row - 1);
     }
 }
 
 void Cursor::moveDown(const Rope& text) {
-    size_t totalLines = std::count(text.to_string().begin(), text.to_string().end(), '\n') + 1;
-    if (row < totalLines - 1) {
-        ++row;
-        updateColPosition(text);
+    size_t row = getRow(text);
+    if (row < text.countLines() - 1) {
+        updateColPosition(text, row + 1);
     }
 }
 
+// A line break is a character like any other, so stepping over one moves
+// between the end of a line and the start of the next
 void Cursor::moveLeft(const Rope& text) {
-    if (col > 0) {
-        --col;
-        preferredCol = col;
-    } else if (row > 0) {
-        --row;
-        col = getLineLength(text, row);
-        preferredCol = col;
+    size_t position = getGlobalPosition();
+    if (position > 0) {
+        marks.move(mark, position - 1);
+        rememberColumn(text);
     }
 }
 
 void Cursor::moveRight(const Rope& text) {
-    size_t lineLength = getLineLength(text, row);
-    if (col < lineLength) {
-        ++col;
-        preferredCol = col;
-    } else {
-        size_t totalLines = std::count(text.to_string().begin(), text.to_string().end(), '\n') + 1;
-        if (row < totalLines - 1){
-            ++row;
-            col = 0;
-            preferredCol = 0;
-        }
+    size_t position = getGlobalPosition();
+    if (position < text.length()) {
+        marks.move(mark, position + 1);
+        rememberColumn(text);
     }
 }
 
@@ -61,34 +63,33 @@ void Cursor::setPosition(const Rope& text, size_t newRow, size_t newCol) {
         throw std::out_of_range("Column is out of range");
     }
 
-    row = newRow;
-    col = newCol;
+    marks.move(mark, text.lineStart(newRow) + newCol);
     preferredCol = newCol;
 }
 
-size_t Cursor::getGlobalPosition(const Rope& text) const {
-    size_t position = 0;
-    for (size_t i = 0; i < row; ++i) {
-        position = text.substring(position, text.length()).find('\n') + 1 + position;
+void Cursor::setGlobalPosition(const Rope& text, size_t position) {
+    if (position > text.length()) {
+        throw std::out_of_range("Position is out of range");
     }
-    return position + col;
+    marks.move(mark, position);
+    rememberColumn(text);
+}
+
+size_t Cursor::getGlobalPosition() const {
+    return marks.offset(mark);
+}
+
+void Cursor::rememberColumn(const Rope& text) {
+    preferredCol = getCol(text);
 }
 
 size_t Cursor::getLineLength(const Rope& text, size_t lineNumber) const {
-    size_t start = 0;
-    for (size_t i = 0; i < lineNumber; ++i) {
-        start = text.substring(start, text.length()).find('\n') + 1 + start;
-    }
-    size_t end = text.substring(start, text.length()).find('\n');
-    if (end == std::string::npos) {
-        end = text.length();
-    } else {
-        end += start;
-    }
+    size_t start = text.lineStart(lineNumber);
+    size_t end = lineNumber + 1 < text.countLines() ? text.lineStart(lineNumber + 1) - 1 : text.length();
     return end - start;
 }
 
-void Cursor::updateColPosition(const Rope& text) {
-    size_t lineLength = getLineLength(text, row);
-    col = std::min(preferredCol, lineLength);
-}
\ No newline at end of file
+void Cursor::updateColPosition(const Rope& text, size_t newRow) {
+    size_t lineLength = getLineLength(text, newRow);
+    marks.move(mark, text.lineStart(newRow) + std::min(preferredCol, lineLength));
+}
@@ -3,19 +3,27 @@
 
 #include <cstddef>
 #include "rope.h"
+#include "marks.h"
 
+// The cursor is a mark, so edits anywhere in the document keep it on the
+// same character; row and column are looked up in the rope's line index
+// when asked for.
 class Cursor {
 private:
-    size_t row; 
-    size_t col;
+    MarkSet& marks;
+    MarkSet::MarkId mark;
     size_t preferredCol;
 
-    // Helper method to get the length of a specific line 
+    // Helper method to get the length of a specific line
     size_t getLineLength(const Rope& text, size_t lineNumber) const;
 
-    void updateColPosition(const Rope& text);
+    void updateColPosition(const Rope& text, size_t newRow);
 public:
-    Cursor();
+    explicit Cursor(MarkSet& marks);
+    ~Cursor();
+
+    Cursor(const Cursor&) = delete;
+    Cursor& operator=(const Cursor&) = delete;
 
     // Movement methods
     void moveUp(const Rope& text);
@@ -25,13 +33,17 @@ public:
 
 
     //Getters
-    size_t getRow() const;
-    size_t getCol() const;
+    size_t getRow(const Rope& text) const;
+    size_t getCol(const Rope& text) const;
 
     // Method to set cursor position directly
     void setPosition(const Rope& text, size_t newRow, size_t newCol);
+    void setGlobalPosition(const Rope& text, size_t position);
+
+    size_t getGlobalPosition() const;
 
-    size_t getGlobalPosition(const Rope& text) const;
+    // Makes the current column the one kept when moving up and down, e.g. after typing
+    void rememberColumn(const Rope& text);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,62 @@
+#include "edit_log.h"
+#include <stdexcept>
+
+EditLog::EditLog() : undoCount(0), undoEnd(0) {}
+
+void EditLog::append(Op op, size_t position, size_t length) {
+    records.resize(undoCount);
+    records.push_back({position, (static_cast<uint64_t>(length) << 1) | (op == Op::Delete ? 1 : 0)});
+    ++undoCount;
+}
+
+void EditLog::recordInsert(size_t position, std::string_view text) {
+    append(Op::Insert, position, text.size());
+    arena.resize(undoEnd);
+    arena.append(text);
+    undoEnd = arena.size();
+}
+
+void EditLog::recordDelete(size_t position, const Rope& document, size_t count) {
+    append(Op::Delete, position, count);
+    arena.resize(undoEnd);
+    document.forEachChunk(position, position + count, [&](const char* data, size_t length) {
+        arena.append(data, length);
+    });
+    undoEnd = arena.size();
+}
+
+bool EditLog::canUndo() const {
+    return undoCount > 0;
+}
+
+bool EditLog::canRedo() const {
+    return undoCount < records.size();
+}
+
+EditLog::Step EditLog::undo() {
+    if (!canUndo()) throw std::out_of_range("Nothing to undo");
+    const Record& record = records[--undoCount];
+    undoEnd -= record.length();
+    std::string_view text(arena.data() + undoEnd, record.length());
+    return {record.op() == Op::Insert ? Op::Delete : Op::Insert, record.position, text};
+}
+
+EditLog::Step EditLog::redo() {
+    if (!canRedo()) throw std::out_of_range("Nothing to redo");
+    const Record& record = records[undoCount++];
+    std::string_view text(arena.data() + undoEnd, record.length());
+    undoEnd += record.length();
+    return {record.op(), record.position, text};
+}
+
+void EditLog::clear() {
+    // Swap rather than clear so a long history gives its memory back
+    std::vector<Record>().swap(records);
+    std::string().swap(arena);
+    undoCount = 0;
+    undoEnd = 0;
+}
+
+EditLog::Stats EditLog::stats() const {
+    return {records.size(), undoCount, records.capacity() * sizeof(Record), arena.capacity()};
+}
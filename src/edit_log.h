@@ -0,0 +1,69 @@
+#ifndef EDIT_LOG_H
+#define EDIT_LOG_H
+
+#include "rope.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Undo/redo history as one array of fixed-size records plus one string that
+// holds the inserted or deleted text of every record back to back. Records
+// [0, undoCount) can be undone and the rest redone; a record's text starts
+// where the previous record's ends, so records don't store an offset.
+class EditLog {
+public:
+    enum class Op : uint8_t { Insert, Delete };
+
+    // One edit to apply to the document. text points into the log and stays
+    // valid until the next record or clear()
+    struct Step {
+        Op op;
+        size_t position;
+        std::string_view text;
+    };
+
+    struct Stats {
+        size_t entries;
+        size_t undoable;
+        size_t recordBytes;
+        size_t textBytes;
+    };
+
+    EditLog();
+
+    // Recording an edit drops everything that could have been redone
+    void recordInsert(size_t position, std::string_view text);
+    // Copies [position, position + count) out of the document before it is removed
+    void recordDelete(size_t position, const Rope& document, size_t count);
+
+    bool canUndo() const;
+    bool canRedo() const;
+    // The edit that reverts the last undoable record
+    Step undo();
+    // The edit that reapplies the first redoable record
+    Step redo();
+
+    void clear();
+    Stats stats() const;
+
+private:
+    // 16 bytes: the op is kept in the low bit of the length
+    struct Record {
+        uint64_t position;
+        uint64_t lengthAndOp;
+
+        Op op() const { return (lengthAndOp & 1) ? Op::Delete : Op::Insert; }
+        size_t length() const { return static_cast<size_t>(lengthAndOp >> 1); }
+    };
+
+    std::vector<Record> records;
+    std::string arena;
+    size_t undoCount;
+    size_t undoEnd;  // end of the text of records [0, undoCount) in arena
+
+    void append(Op op, size_t position, size_t length);
+};
+
+#endif
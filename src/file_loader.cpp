@@ -0,0 +1,84 @@
+#include "file_loader.h"
+#include <algorithm>
+
+namespace {
+
+// In-memory leaves; small enough that the first one is ready almost at once
+const size_t kLeafSize = 64 * 1024;
+// Leaves left on disk in large-file mode, matching Rope::fromFile
+const size_t kPagedLeafSize = 256 * 1024;
+
+} // namespace
+
+FileLoader::FileLoader(const std::string& path, std::shared_ptr<LeafCache> cache)
+    : file(BackingFile::open(path)), cache(std::move(cache)), total(file->size()),
+      finished(false), failed(false), cancelled(false) {
+    worker = std::thread(&FileLoader::run, this);
+}
+
+FileLoader::~FileLoader() {
+    cancel();
+    worker.join();
+}
+
+void FileLoader::run() {
+    size_t leafSize = cache ? kPagedLeafSize : kLeafSize;
+    std::string buffer;
+    try {
+        for (uint64_t offset = 0; offset < total && !cancelled; offset += leafSize) {
+            size_t length = static_cast<size_t>(std::min<uint64_t>(leafSize, total - offset));
+            buffer.resize(length);
+            file->read(offset, &buffer[0], length);
+
+            // Leaves built here never touch the cache until they are paged in,
+            // so creating them off the editor's thread is safe
+            std::shared_ptr<Leaf> leaf;
+            if (cache) {
+                size_t newlines = std::count(buffer.begin(), buffer.end(), '\n');
+                leaf = std::make_shared<Leaf>(file, offset, length, newlines, cache);
+            } else {
+                leaf = std::make_shared<Leaf>(buffer);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(std::move(leaf));
+            dataReady.notify_all();
+        }
+    } catch (const std::exception&) {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = true;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+    dataReady.notify_all();
+}
+
+void FileLoader::waitForData() {
+    std::unique_lock<std::mutex> lock(mutex);
+    dataReady.wait(lock, [&] { return !ready.empty() || finished; });
+}
+
+std::vector<std::shared_ptr<Leaf> > FileLoader::takeLeaves() {
+    std::vector<std::shared_ptr<Leaf> > leaves;
+    std::lock_guard<std::mutex> lock(mutex);
+    leaves.swap(ready);
+    return leaves;
+}
+
+void FileLoader::cancel() {
+    cancelled = true;
+}
+
+bool FileLoader::isDone() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return finished && ready.empty();
+}
+
+bool FileLoader::hasFailed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+uint64_t FileLoader::totalBytes() const {
+    return total;
+}
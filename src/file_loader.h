@@ -0,0 +1,61 @@
+#ifndef FILE_LOADER_H
+#define FILE_LOADER_H
+
+#include "leaf_cache.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LoadProgress {
+    uint64_t bytesLoaded;
+    uint64_t totalBytes;
+    bool loading;
+};
+
+// Reads a file into rope leaves on a background thread. The thread only
+// builds leaves; the editor takes them with takeLeaves() and appends them to
+// its rope on its own thread, so the rope itself is never shared.
+class FileLoader {
+public:
+    // With a cache the leaves stay on disk and only their newlines are
+    // counted (large-file mode); otherwise the text is read into memory
+    FileLoader(const std::string& path, std::shared_ptr<LeafCache> cache);
+    ~FileLoader();
+
+    FileLoader(const FileLoader&) = delete;
+    FileLoader& operator=(const FileLoader&) = delete;
+
+    // Blocks until at least one leaf is ready or the load has ended
+    void waitForData();
+    std::vector<std::shared_ptr<Leaf> > takeLeaves();
+
+    // Stops reading after the current block; leaves already read can still be taken
+    void cancel();
+    // True once the thread has stopped and every leaf has been taken
+    bool isDone() const;
+    bool hasFailed() const;
+    uint64_t totalBytes() const;
+
+private:
+    std::shared_ptr<BackingFile> file;
+    std::shared_ptr<LeafCache> cache;
+    uint64_t total;
+
+    mutable std::mutex mutex;
+    std::condition_variable dataReady;
+    std::vector<std::shared_ptr<Leaf> > ready;
+    bool finished;
+    bool failed;
+    std::atomic<bool> cancelled;
+    std::thread worker;
+
+    void run();
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "highlighter.h"
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+#include <unordered_set>
+
+namespace {
+
+const int kInBlockComment = 1;
+
+bool isKeyword(std::string_view word) {
+    static const std::unordered_set<std::string_view> keywords = {
+        "auto", "bool", "break", "case", "catch", "char", "class", "const", "constexpr", "continue",
+        "default", "delete", "do", "double", "else", "enum", "explicit", "extern", "false", "float",
+        "for", "friend", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+        "nullptr", "operator", "override", "private", "protected", "public", "return", "short",
+        "signed", "sizeof", "static", "struct", "switch", "template", "this", "throw", "true", "try",
+        "typedef", "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "while"};
+    return keywords.count(word) > 0;
+}
+
+// Reads a document line by line from a given line on, a block at a time, so
+// lexing a long run of lines doesn't look each one up in the rope separately
+class LineReader {
+    const Rope* text;
+    size_t pos;
+    std::string buffer;
+    size_t bufferPos;
+public:
+    LineReader(const Rope& text, size_t line) : text(&text), pos(text.lineStart(line)), bufferPos(0) {}
+
+    std::string next() {
+        std::string line;
+        while (true) {
+            if (bufferPos == buffer.size()) {
+                if (pos >= text->length()) return line;
+                size_t end = std::min(pos + 64 * 1024, text->length());
+                buffer = text->substring(pos, end);
+                bufferPos = 0;
+                pos = end;
+            }
+            size_t newline = buffer.find('\n', bufferPos);
+            if (newline == std::string::npos) {
+                line.append(buffer, bufferPos, std::string::npos);
+                bufferPos = buffer.size();
+            } else {
+                line.append(buffer, bufferPos, newline - bufferPos);
+                bufferPos = newline + 1;
+                return line;
+            }
+        }
+    }
+};
+
+} // namespace
+
+int CppTokenizer::tokenizeLine(const std::string& line, int state, std::vector<HighlightSpan>& spans) const {
+    size_t i = 0;
+    if (state == kInBlockComment) {
+        size_t end = line.find("*/");
+        if (end == std::string::npos) {
+            if (!line.empty()) spans.push_back({0, line.length(), TokenType::Comment});
+            return kInBlockComment;
+        }
+        spans.push_back({0, end + 2, TokenType::Comment});
+        i = end + 2;
+    }
+
+    size_t firstNonBlank = line.find_first_not_of(" \t");
+    if (i == 0 && firstNonBlank != std::string::npos && line[firstNonBlank] == '#') {
+        spans.push_back({firstNonBlank, line.length() - firstNonBlank, TokenType::Preprocessor});
+        return 0;
+    }
+
+    while (i < line.length()) {
+        char c = line[i];
+        if (c == '/' && i + 1 < line.length() && line[i + 1] == '/') {
+            spans.push_back({i, line.length() - i, TokenType::Comment});
+            return 0;
+        } else if (c == '/' && i + 1 < line.length() && line[i + 1] == '*') {
+            size_t end = line.find("*/", i + 2);
+            if (end == std::string::npos) {
+                spans.push_back({i, line.length() - i, TokenType::Comment});
+                return kInBlockComment;
+            }
+            spans.push_back({i, end + 2 - i, TokenType::Comment});
+            i = end + 2;
+        } else if (c == '"' || c == '\'') {
+            size_t end = i + 1;
+            while (end < line.length() && line[end] != c) {
+                end += line[end] == '\\' ? 2 : 1;
+            }
+            end = std::min(end + 1, line.length());
+            spans.push_back({i, end - i, TokenType::String});
+            i = end;
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            size_t end = i;
+            while (end < line.length() && (std::isalnum(static_cast<unsigned char>(line[end])) ||
+                                           line[end] == '.' || line[end] == '\'')) {
+                ++end;
+            }
+            spans.push_back({i, end - i, TokenType::Number});
+            i = end;
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t end = i;
+            while (end < line.length() && (std::isalnum(static_cast<unsigned char>(line[end])) || line[end] == '_')) {
+                ++end;
+            }
+            if (isKeyword(std::string_view(line).substr(i, end - i))) {
+                spans.push_back({i, end - i, TokenType::Keyword});
+            }
+            i = end;
+        } else {
+            ++i;
+        }
+    }
+    return 0;
+}
+
+HighlightCache::HighlightCache() : firstInvalid(1), convergeFrom(1), knownEnd(1), linesLexed(0) {}
+
+void HighlightCache::setTokenizer(std::unique_ptr<Tokenizer> newTokenizer, size_t lineCount) {
+    tokenizer = std::move(newTokenizer);
+    reset(lineCount);
+}
+
+bool HighlightCache::isEnabled() const {
+    return tokenizer != nullptr;
+}
+
+void HighlightCache::reset(size_t lineCount) {
+    lineStates.clear();
+    if (tokenizer) lineStates.assign(lineCount, tokenizer->initialState());
+    firstInvalid = 1;
+    convergeFrom = 1;
+    knownEnd = 1;
+}
+
+void HighlightCache::linesChanged(size_t firstLine, size_t removedLines, size_t insertedLines) {
+    if (!tokenizer) return;
+
+    // The state at the start of firstLine doesn't depend on firstLine itself
+    auto from = lineStates.begin() + firstLine + 1;
+    lineStates.erase(from, from + removedLines);
+    lineStates.insert(lineStates.begin() + firstLine + 1, insertedLines, 0);
+
+    size_t editEnd = firstLine + removedLines;
+    auto shift = [&](size_t line) {
+        if (line > editEnd) return line - removedLines + insertedLines;
+        return std::min(line, firstLine + 1);
+    };
+    firstInvalid = std::min(firstInvalid, firstLine + 1);
+    knownEnd = shift(knownEnd);
+    convergeFrom = std::max(shift(convergeFrom), firstLine + insertedLines + 1);
+}
+
+void HighlightCache::ensureStates(const Rope& text, size_t line) {
+    if (!tokenizer || firstInvalid > line) return;
+
+    std::vector<HighlightSpan> scratch;
+    LineReader reader(text, firstInvalid - 1);
+    while (firstInvalid <= line) {
+        size_t current = firstInvalid;
+        scratch.clear();
+        int state = tokenizer->tokenizeLine(reader.next(), lineStates[current - 1], scratch);
+        ++linesLexed;
+
+        if (current >= convergeFrom && current < knownEnd && lineStates[current] == state) {
+            // Same state as before the edit: everything already computed below still holds
+            firstInvalid = knownEnd;
+            if (firstInvalid <= line) reader = LineReader(text, firstInvalid - 1);
+            continue;
+        }
+        lineStates[current] = state;
+        firstInvalid = current + 1;
+        knownEnd = std::max(knownEnd, firstInvalid);
+    }
+}
+
+std::vector<HighlightedLine> HighlightCache::highlight(const Rope& text, size_t first, size_t count) {
+    std::vector<HighlightedLine> lines;
+    size_t total = text.countLines();
+    if (first >= total || count == 0) return lines;
+    size_t last = std::min(first + count, total);
+
+    ensureStates(text, last - 1);
+    LineReader reader(text, first);
+    for (size_t line = first; line < last; ++line) {
+        HighlightedLine highlighted;
+        highlighted.text = reader.next();
+        if (tokenizer) tokenizer->tokenizeLine(highlighted.text, lineStates[line], highlighted.spans);
+        lines.push_back(std::move(highlighted));
+    }
+    return lines;
+}
+
+size_t HighlightCache::takeLinesLexed() {
+    size_t count = linesLexed;
+    linesLexed = 0;
+    return count;
+}
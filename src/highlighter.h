@@ -0,0 +1,72 @@
+#ifndef HIGHLIGHTER_H
+#define HIGHLIGHTER_H
+
+#include "rope.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class TokenType { Keyword, String, Number, Comment, Preprocessor };
+
+struct HighlightSpan {
+    size_t start;
+    size_t length;
+    TokenType type;
+};
+
+struct HighlightedLine {
+    std::string text;
+    std::vector<HighlightSpan> spans;
+};
+
+// A line-at-a-time lexer. Everything it needs to carry from one line to the
+// next (e.g. "inside a block comment") is packed into an int, which is what
+// lets HighlightCache resume lexing at any line.
+class Tokenizer {
+public:
+    virtual ~Tokenizer() = default;
+    virtual int initialState() const { return 0; }
+    // Appends the spans of line and returns the state at the start of the next line
+    virtual int tokenizeLine(const std::string& line, int state, std::vector<HighlightSpan>& spans) const = 0;
+};
+
+class CppTokenizer : public Tokenizer {
+public:
+    int tokenizeLine(const std::string& line, int state, std::vector<HighlightSpan>& spans) const override;
+};
+
+// Lexer state at the start of every line. After an edit, lexing restarts at
+// the changed line and stops as soon as it produces the same state that was
+// stored for a line past the edit, since nothing after that can change.
+// Lines are only lexed when something below them is asked for.
+class HighlightCache {
+private:
+    std::unique_ptr<Tokenizer> tokenizer;
+    std::vector<int> lineStates;
+    size_t firstInvalid;   // states before this line are known to be right
+    size_t convergeFrom;   // from here on, stored states are old but likely still right
+    size_t knownEnd;       // states from here on were never computed
+    size_t linesLexed;
+
+    void ensureStates(const Rope& text, size_t line);
+
+public:
+    HighlightCache();
+
+    void setTokenizer(std::unique_ptr<Tokenizer> newTokenizer, size_t lineCount);
+    bool isEnabled() const;
+
+    // Forgets all states, e.g. after a new document was loaded
+    void reset(size_t lineCount);
+    // An edit starting on firstLine removed and inserted the given number of line breaks
+    void linesChanged(size_t firstLine, size_t removedLines, size_t insertedLines);
+
+    // Spans for lines [first, first + count), lexing only as far as needed
+    std::vector<HighlightedLine> highlight(const Rope& text, size_t first, size_t count);
+
+    // Lines run through the tokenizer since the last call
+    size_t takeLinesLexed();
+};
+
+#endif
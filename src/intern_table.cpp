@@ -0,0 +1,95 @@
+#include "intern_table.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+
+const size_t kMinChunk = 16 * 1024;
+const size_t kMaxChunk = 256 * 1024;
+// Top 16 bits of the rolling hash zero: a cut roughly every 64 KB past the minimum
+const uint64_t kCutMask = 0xFFFF000000000000ULL;
+
+// Random value per byte for the gear rolling hash, fixed so cut points are stable across runs
+const std::array<uint64_t, 256>& gearTable() {
+    static const std::array<uint64_t, 256> table = [] {
+        std::array<uint64_t, 256> values;
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (auto& value : values) {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            value = z ^ (z >> 31);
+        }
+        return values;
+    }();
+    return table;
+}
+
+uint64_t contentHash(const char* data, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash ^ length;
+}
+
+} // namespace
+
+LeafInternTable::LeafInternTable() : lookups(0), hits(0), sweepAt(1024) {}
+
+std::shared_ptr<Leaf> LeafInternTable::intern(const char* data, size_t length) {
+    ++lookups;
+    uint64_t hash = contentHash(data, length);
+    auto range = table.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+        auto leaf = it->second.lock();
+        if (!leaf) {
+            it = table.erase(it);
+            continue;
+        }
+        if (leaf->length() == length) {
+            auto text = leaf->text();
+            if (std::memcmp(text->data(), data, length) == 0) {
+                ++hits;
+                return leaf;
+            }
+        }
+        ++it;
+    }
+
+    auto leaf = std::make_shared<Leaf>(std::string(data, length));
+    table.emplace(hash, leaf);
+    if (table.size() >= sweepAt) sweep();
+    return leaf;
+}
+
+LeafInternTable::Stats LeafInternTable::stats() const {
+    return {lookups, hits, table.size()};
+}
+
+// Drops entries whose leaves have been freed, so the table stays
+// proportional to the live leaves rather than to everything ever interned
+void LeafInternTable::sweep() {
+    for (auto it = table.begin(); it != table.end();) {
+        if (it->second.expired()) {
+            it = table.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    sweepAt = std::max<size_t>(1024, table.size() * 2);
+}
+
+size_t LeafInternTable::chunkLength(const char* data, size_t length, bool atEnd) {
+    const auto& gear = gearTable();
+    size_t limit = std::min(length, kMaxChunk);
+    uint64_t hash = 0;
+    for (size_t i = kMinChunk; i < limit; ++i) {
+        hash = (hash << 1) + gear[static_cast<unsigned char>(data[i])];
+        if ((hash & kCutMask) == 0) return i + 1;
+    }
+    if (length >= kMaxChunk) return kMaxChunk;
+    return atEnd ? length : 0;
+}
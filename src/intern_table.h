@@ -0,0 +1,48 @@
+#ifndef INTERN_TABLE_H
+#define INTERN_TABLE_H
+
+#include "leaf_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Content-addressed table of rope leaves. Ropes built through the same table
+// share one Leaf for every chunk of identical text, so opening many similar
+// files stores each distinct chunk once. The table only holds weak
+// references: a leaf is freed as soon as no rope uses it.
+class LeafInternTable {
+public:
+    struct Stats {
+        uint64_t lookups;
+        uint64_t hits;
+        size_t entries;
+    };
+
+    LeafInternTable();
+
+    LeafInternTable(const LeafInternTable&) = delete;
+    LeafInternTable& operator=(const LeafInternTable&) = delete;
+
+    // Returns the shared leaf holding exactly this text, creating it if needed
+    std::shared_ptr<Leaf> intern(const char* data, size_t length);
+
+    Stats stats() const;
+
+    // Content-defined chunking: returns where the first chunk of data ends.
+    // Cut points depend only on nearby bytes, so an edit near the start of a
+    // file does not shift every later chunk and defeat deduplication.
+    // Returns 0 when more input is needed to decide (unless atEnd).
+    static size_t chunkLength(const char* data, size_t length, bool atEnd);
+
+private:
+    std::unordered_multimap<uint64_t, std::weak_ptr<Leaf> > table;
+    uint64_t lookups;
+    uint64_t hits;
+    size_t sweepAt;
+
+    void sweep();
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include "journal.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char kMagic[4] = {'T', 'E', 'J', '1'};
+const size_t kHeaderSize = sizeof(kMagic) + sizeof(uint64_t);
+const size_t kRecordFixedSize = 1 + sizeof(uint64_t) * 2;
+const size_t kBatchBytes = 64 * 1024;
+const std::chrono::milliseconds kFlushInterval(20);
+
+// Records are stored in host byte order; the journal is never moved between machines
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T get(const std::string& in, size_t offset) {
+    T value;
+    std::memcpy(&value, in.data() + offset, sizeof(value));
+    return value;
+}
+
+uint32_t recordHash(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+std::string encode(EditJournal::Op op, uint64_t position, uint64_t count, std::string_view text) {
+    std::string record;
+    record.reserve(kRecordFixedSize + text.size() + sizeof(uint32_t));
+    put(record, static_cast<uint8_t>(op));
+    put(record, position);
+    put(record, count);
+    record += text;
+    put(record, recordHash(record.data(), record.size()));
+    return record;
+}
+
+bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0) return false;
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace
+
+EditJournal::EditJournal(const std::string& path, uint64_t baseChecksum)
+    : path(path), fd(-1), appendedBytes(0), appendedSeq(0), durableSeq(0),
+      syncWanted(false), stopping(false), writeFailed(false) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) throw std::runtime_error("Unable to open journal");
+
+    if (!readExisting(baseChecksum)) {
+        recovered.clear();
+        if (::ftruncate(fd, 0) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Unable to reset journal");
+        }
+        writeHeader(baseChecksum);
+    }
+    flusher = std::thread(&EditJournal::flushLoop, this);
+}
+
+EditJournal::~EditJournal() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    flushRequested.notify_one();
+    flusher.join();
+    ::close(fd);
+}
+
+void EditJournal::recordInsert(size_t position, std::string_view str) {
+    append(encode(Op::Insert, position, str.length(), str));
+}
+
+void EditJournal::recordDelete(size_t position, size_t count) {
+    append(encode(Op::Delete, position, count, ""));
+}
+
+void EditJournal::append(const std::string& record) {
+    bool batchFull;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (writeFailed) throw std::runtime_error("Journal write failed; edits are no longer recorded");
+        pending += record;
+        appendedBytes += record.size();
+        ++appendedSeq;
+        batchFull = pending.size() >= kBatchBytes;
+    }
+    if (batchFull) flushRequested.notify_one();
+}
+
+void EditJournal::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t target = appendedSeq;
+    syncWanted = true;
+    flushRequested.notify_one();
+    flushDone.wait(lock, [&] { return durableSeq >= target || writeFailed; });
+    if (writeFailed) throw std::runtime_error("Journal write failed");
+}
+
+void EditJournal::reset(uint64_t baseChecksum) {
+    // After a failed write the records are incomplete anyway, and the
+    // checkpoint that comes before a reset holds everything they described
+    if (!hasFailed()) sync();
+    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> io(ioMutex);
+    pending.clear();
+    appendedBytes = 0;
+    if (::ftruncate(fd, 0) != 0) throw std::runtime_error("Unable to reset journal");
+    writeHeader(baseChecksum);
+    durableSeq = appendedSeq;
+    writeFailed = false;
+}
+
+bool EditJournal::hasFailed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writeFailed;
+}
+
+std::vector<EditJournal::Entry> EditJournal::takeRecoveredEntries() {
+    return std::move(recovered);
+}
+
+uint64_t EditJournal::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return appendedBytes;
+}
+
+void EditJournal::flushLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        flushRequested.wait_for(lock, kFlushInterval, [&] {
+            return stopping || syncWanted || pending.size() >= kBatchBytes;
+        });
+        syncWanted = false;
+        // Once a batch is lost nothing more may reach the file: recovery
+        // would replay later records at positions that assumed the lost ones
+        if (writeFailed) pending.clear();
+        if (pending.empty()) {
+            if (stopping) break;
+            continue;
+        }
+
+        // Everything appended while the previous batch was being written
+        // goes out together with a single fsync
+        std::string batch;
+        batch.swap(pending);
+        uint64_t seq = appendedSeq;
+        lock.unlock();
+        bool ok;
+        {
+            std::lock_guard<std::mutex> io(ioMutex);
+            ok = writeAll(fd, batch.data(), batch.size()) && ::fsync(fd) == 0;
+        }
+        lock.lock();
+        if (ok) {
+            durableSeq = seq;
+        } else {
+            writeFailed = true;
+        }
+        flushDone.notify_all();
+    }
+}
+
+void EditJournal::writeHeader(uint64_t baseChecksum) {
+    std::string header(kMagic, sizeof(kMagic));
+    put(header, baseChecksum);
+    if (!writeAll(fd, header.data(), header.size()) || ::fsync(fd) != 0) {
+        throw std::runtime_error("Unable to write journal header");
+    }
+}
+
+// Collects the intact records of an existing journal and cuts off a torn
+// tail left by a crash in the middle of a write
+bool EditJournal::readExisting(uint64_t baseChecksum) {
+    std::string content;
+    char buffer[64 * 1024];
+    ssize_t n;
+    if (::lseek(fd, 0, SEEK_SET) < 0) return false;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+        content.append(buffer, static_cast<size_t>(n));
+    }
+    if (n < 0 || content.size() < kHeaderSize) return false;
+    if (std::memcmp(content.data(), kMagic, sizeof(kMagic)) != 0) return false;
+    if (get<uint64_t>(content, sizeof(kMagic)) != baseChecksum) return false;
+
+    size_t offset = kHeaderSize;
+    while (offset + kRecordFixedSize + sizeof(uint32_t) <= content.size()) {
+        Entry entry;
+        entry.op = static_cast<Op>(get<uint8_t>(content, offset));
+        entry.position = get<uint64_t>(content, offset + 1);
+        entry.count = get<uint64_t>(content, offset + 1 + sizeof(uint64_t));
+        if (entry.op != Op::Insert && entry.op != Op::Delete) break;
+
+        size_t payload = entry.op == Op::Insert ? entry.count : 0;
+        size_t end = offset + kRecordFixedSize + payload;
+        if (payload > content.size() || end + sizeof(uint32_t) > content.size()) break;
+        if (get<uint32_t>(content, end) != recordHash(content.data() + offset, end - offset)) break;
+
+        entry.text = content.substr(offset + kRecordFixedSize, payload);
+        recovered.push_back(std::move(entry));
+        offset = end + sizeof(uint32_t);
+    }
+
+    if (offset != content.size() && ::ftruncate(fd, offset) != 0) return false;
+    appendedBytes = offset - kHeaderSize;
+    return true;
+}
+
+void EditJournal::replaceFileDurably(const std::string& path, const Rope& content) {
+    std::string tempPath = path + ".tmp";
+    int out = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) throw std::runtime_error("Unable to save file");
+    bool ok = true;
+    content.forEachChunk(0, content.length(), [&](const char* data, size_t count) {
+        ok = ok && writeAll(out, data, count);
+    });
+    ok = ok && ::fsync(out) == 0;
+    ::close(out);
+    if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        ::unlink(tempPath.c_str());
+        throw std::runtime_error("Unable to save file");
+    }
+
+    // Make the rename itself durable
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int dirFd = ::open(dir.c_str(), O_RDONLY);
+    if (dirFd >= 0) {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+}
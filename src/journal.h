@@ -0,0 +1,87 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "rope.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Append-only log of the insert/delete operations applied to a base file.
+//
+// Appends only copy the record into an in-memory batch; a background thread
+// writes the batch and fsyncs it (group commit), so a keystroke never waits
+// for the disk. The header stores the checksum of the base file the records
+// apply to, which makes checkpointing crash safe: once the base file has been
+// replaced, the old journal no longer matches it and is ignored on recovery.
+class EditJournal {
+public:
+    enum class Op : uint8_t { Insert = 1, Delete = 2 };
+
+    struct Entry {
+        Op op;
+        uint64_t position;
+        uint64_t count;    // characters removed, for Delete
+        std::string text;  // characters added, for Insert
+    };
+
+    // Opens the journal at path. If it already holds records for a base file
+    // with the given checksum they are kept (see takeRecoveredEntries) and new
+    // records are appended after them; otherwise the journal starts empty.
+    EditJournal(const std::string& path, uint64_t baseChecksum);
+    ~EditJournal();
+
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+
+    void recordInsert(size_t position, std::string_view str);
+    void recordDelete(size_t position, size_t count);
+    // Both throw once a batch failed to reach the disk; the journal then ends
+    // at the last batch that did, and nothing after it is written
+
+    // Blocks until every record appended so far is on disk
+    void sync();
+
+    // Drops all records after the base file was checkpointed. Also clears a
+    // write failure, since the journal starts over from the new base.
+    void reset(uint64_t baseChecksum);
+    bool hasFailed() const;
+
+    // Records found on disk when the journal was opened, in order
+    std::vector<Entry> takeRecoveredEntries();
+
+    // Bytes of records written since the last reset
+    uint64_t size() const;
+
+    // Writes content to a temporary file, fsyncs it and renames it over path
+    static void replaceFileDurably(const std::string& path, const Rope& content);
+
+private:
+    std::string path;
+    int fd;
+    std::vector<Entry> recovered;
+
+    mutable std::mutex mutex;
+    std::condition_variable flushRequested;
+    std::condition_variable flushDone;
+    std::string pending;
+    uint64_t appendedBytes;   // records accepted since the last reset
+    uint64_t appendedSeq;     // batches are identified by how many appends they cover
+    uint64_t durableSeq;
+    bool syncWanted;
+    bool stopping;
+    bool writeFailed;
+    std::mutex ioMutex;       // serialises writes to fd between the flusher and reset()
+    std::thread flusher;
+
+    void append(const std::string& record);
+    void flushLoop();
+    void writeHeader(uint64_t baseChecksum);
+    bool readExisting(uint64_t baseChecksum);
+};
+
+#endif
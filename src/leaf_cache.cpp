@@ -0,0 +1,147 @@
+#include "leaf_cache.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+BackingFile::BackingFile(int fd) : fd(fd), end(0) {
+    struct stat info;
+    if (::fstat(fd, &info) == 0) end = static_cast<uint64_t>(info.st_size);
+}
+
+BackingFile::~BackingFile() {
+    ::close(fd);
+}
+
+std::shared_ptr<BackingFile> BackingFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Unable to open file");
+    return std::make_shared<BackingFile>(fd);
+}
+
+std::shared_ptr<BackingFile> BackingFile::createSwap() {
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/text_editor_swap_XXXXXX";
+    int fd = ::mkstemp(&path[0]);
+    if (fd < 0) throw std::runtime_error("Unable to create swap file");
+    // The file disappears as soon as the descriptor is closed
+    ::unlink(path.c_str());
+    return std::make_shared<BackingFile>(fd);
+}
+
+void BackingFile::read(uint64_t offset, char* out, size_t length) const {
+    while (length > 0) {
+        ssize_t n = ::pread(fd, out, length, static_cast<off_t>(offset));
+        if (n <= 0) throw std::runtime_error("Unable to read backing file");
+        out += n;
+        offset += static_cast<uint64_t>(n);
+        length -= static_cast<size_t>(n);
+    }
+}
+
+uint64_t BackingFile::append(const char* data, size_t length) {
+    uint64_t start = end;
+    while (length > 0) {
+        ssize_t n = ::pwrite(fd, data, length, static_cast<off_t>(end));
+        if (n <= 0) throw std::runtime_error("Unable to write swap file");
+        data += n;
+        end += static_cast<uint64_t>(n);
+        length -= static_cast<size_t>(n);
+    }
+    return start;
+}
+
+uint64_t BackingFile::size() const {
+    return end;
+}
+
+Leaf::Leaf(std::string text, std::shared_ptr<LeafCache> cache,
+           std::shared_ptr<BackingFile> file, uint64_t offset)
+    : file(std::move(file)), fileOffset(offset), len(text.length()),
+      lines(std::count(text.begin(), text.end(), '\n')), owner(std::move(cache)), cached(false) {
+    data = std::make_shared<const std::string>(std::move(text));
+    if (owner) owner->admit(this);
+}
+
+Leaf::Leaf(std::shared_ptr<BackingFile> file, uint64_t offset, size_t length, size_t newlines,
+           std::shared_ptr<LeafCache> cache)
+    : file(std::move(file)), fileOffset(offset), len(length), lines(newlines),
+      owner(std::move(cache)), cached(false) {}
+
+Leaf::~Leaf() {
+    if (owner && cached) owner->forget(this);
+}
+
+std::shared_ptr<const std::string> Leaf::text() const {
+    if (data) {
+        if (owner) owner->touch(this);
+        return data;
+    }
+
+    auto buffer = std::make_shared<std::string>(len, '\0');
+    file->read(fileOffset, &(*buffer)[0], len);
+    // Only keep the text once the cache has room for it; if evicting
+    // something else fails the leaf stays paged out
+    owner->admit(this);
+    data = buffer;
+    ++owner->misses;
+    return data;
+}
+
+std::shared_ptr<Leaf> Leaf::slice(size_t from, size_t to) const {
+    std::string part = text()->substr(from, to - from);
+    if (file) return std::make_shared<Leaf>(std::move(part), owner, file, fileOffset + from);
+    return std::make_shared<Leaf>(std::move(part), owner);
+}
+
+LeafCache::LeafCache(size_t budgetBytes)
+    : budget(budgetBytes), resident(0), hits(0), misses(0), evictions(0) {}
+
+LeafCache::Stats LeafCache::stats() const {
+    return {hits, misses, evictions, resident, budget, swap ? swap->size() : 0};
+}
+
+void LeafCache::touch(const Leaf* leaf) {
+    ++hits;
+    lru.splice(lru.begin(), lru, leaf->lruPos);
+}
+
+// Makes a leaf resident and evicts the least recently used ones until the
+// budget holds again. The new leaf itself is never evicted here, so a single
+// leaf larger than the budget can still be read. If an eviction fails (the
+// swap file can't be written) the new leaf is taken off the list again, since
+// it may be a leaf whose constructor is about to throw.
+void LeafCache::admit(const Leaf* leaf) {
+    lru.push_front(leaf);
+    leaf->lruPos = lru.begin();
+    leaf->cached = true;
+    resident += leaf->len;
+    try {
+        while (resident > budget && lru.back() != leaf) {
+            evict(lru.back());
+        }
+    } catch (...) {
+        forget(leaf);
+        throw;
+    }
+}
+
+void LeafCache::forget(const Leaf* leaf) {
+    lru.erase(leaf->lruPos);
+    leaf->cached = false;
+    resident -= leaf->len;
+}
+
+void LeafCache::evict(const Leaf* leaf) {
+    if (!leaf->file) {
+        if (!swap) swap = BackingFile::createSwap();
+        leaf->fileOffset = swap->append(leaf->data->data(), leaf->len);
+        leaf->file = swap;
+    }
+    leaf->data.reset();
+    forget(leaf);
+    ++evictions;
+}
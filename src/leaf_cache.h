@@ -0,0 +1,113 @@
+#ifndef LEAF_CACHE_H
+#define LEAF_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+
+// An open file that rope leaves can be paged back in from: either the file
+// the document was loaded from or an anonymous swap file
+class BackingFile {
+public:
+    explicit BackingFile(int fd);
+    ~BackingFile();
+
+    BackingFile(const BackingFile&) = delete;
+    BackingFile& operator=(const BackingFile&) = delete;
+
+    static std::shared_ptr<BackingFile> open(const std::string& path);
+    static std::shared_ptr<BackingFile> createSwap();
+
+    void read(uint64_t offset, char* out, size_t length) const;
+    // Appends to the end of the file and returns the offset written at
+    uint64_t append(const char* data, size_t length);
+    uint64_t size() const;
+
+private:
+    int fd;
+    uint64_t end;
+};
+
+class LeafCache;
+
+// Immutable chunk of text held by a rope leaf. Length and newline count are
+// always resident; when the leaf belongs to a LeafCache the characters may be
+// evicted and are read back from the backing file on the next access.
+class Leaf {
+public:
+    Leaf(std::string text, std::shared_ptr<LeafCache> cache = nullptr,
+         std::shared_ptr<BackingFile> file = nullptr, uint64_t offset = 0);
+    // Leaf whose characters are only on disk until first accessed
+    Leaf(std::shared_ptr<BackingFile> file, uint64_t offset, size_t length, size_t newlines,
+         std::shared_ptr<LeafCache> cache);
+    ~Leaf();
+
+    Leaf(const Leaf&) = delete;
+    Leaf& operator=(const Leaf&) = delete;
+
+    size_t length() const { return len; }
+    size_t newlines() const { return lines; }
+    bool isResident() const { return data != nullptr; }
+
+    // Returns the characters, paging them in if needed. The returned pointer
+    // stays valid even if the leaf is evicted while it is held.
+    std::shared_ptr<const std::string> text() const;
+
+    // New leaf holding [from, to) of this one; keeps pointing at the same
+    // backing file range so it can be evicted without a swap write
+    std::shared_ptr<Leaf> slice(size_t from, size_t to) const;
+
+    const std::shared_ptr<LeafCache>& cache() const { return owner; }
+
+private:
+    friend class LeafCache;
+
+    mutable std::shared_ptr<const std::string> data;
+    mutable std::shared_ptr<BackingFile> file;
+    mutable uint64_t fileOffset;
+    size_t len;
+    size_t lines;
+    std::shared_ptr<LeafCache> owner;
+    mutable std::list<const Leaf*>::iterator lruPos;
+    mutable bool cached;
+};
+
+// Least-recently-used set of resident leaves with a byte budget. Leaves that
+// have never been written anywhere are spilled to a swap file on eviction.
+class LeafCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t residentBytes;
+        size_t budgetBytes;
+        uint64_t swapBytes;
+    };
+
+    explicit LeafCache(size_t budgetBytes);
+
+    LeafCache(const LeafCache&) = delete;
+    LeafCache& operator=(const LeafCache&) = delete;
+
+    Stats stats() const;
+
+private:
+    friend class Leaf;
+
+    std::list<const Leaf*> lru;
+    size_t budget;
+    size_t resident;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    std::shared_ptr<BackingFile> swap;
+
+    void touch(const Leaf* leaf);
+    void admit(const Leaf* leaf);
+    void forget(const Leaf* leaf);
+    void evict(const Leaf* leaf);
+};
+
+#endif
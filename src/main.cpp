@@ -1,85 +1,88 @@
-#include "text_editor.h"
+#include "buffer_manager.h"
+#include "session.h"
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 
-void printHelp() {
-    std::cout << "Available commands: \n"
-            << " i <text> - Insert text at cursor\n"
-            << " d <n> - Delete n characters from cursor\n"
-            << " m <row> <col> - Move cursor\n"
-            << " g <line> - Go to line\n"
-            << " p - Print current text\n"
-            << " u - Undo\n"
-            << " r - Redo\n"
-            << " f <text> - Find text\n"
-            << " s <old> <new> - Replace text\n"
-            << " o <filename> - Open file\n"
-            << " w <filename> - Write to file\n"
-            << " q - Quit\n"
-            << " h - Show this help\n";
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [--record <file>]\n"
+            << "       " << program << " --replay <script> [--log <file>]\n"
+            << "  --record <file>  Save every interactive command to <file>\n"
+            << "  --replay <file>  Apply the commands in <file> headlessly and report timing\n"
+            << "  --log <file>     Keep the output of a replay instead of discarding it\n";
 }
 
-int main() {
-    TextEditor editor;
-    std::string command;
+int runReplay(const std::string& scriptPath, const std::string& logPath) {
+    std::ifstream script(scriptPath);
+    if (!script) {
+        std::cerr << "Unable to open replay script: " << scriptPath << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<std::ofstream> log;
+    if (!logPath.empty()) {
+        log = std::make_unique<std::ofstream>(logPath);
+        if (!*log) {
+            std::cerr << "Unable to open log file: " << logPath << std::endl;
+            return 1;
+        }
+    }
+
+    BufferManager buffers;
+    ReplayStats stats = replaySession(buffers, script, log.get());
+
+    double opsPerSecond = stats.seconds > 0 ? stats.operations / stats.seconds : 0.0;
+    std::cout << "Operations: " << stats.operations << "\n"
+            << "Errors: " << stats.errors << "\n"
+            << "Total time: " << stats.seconds << " s\n"
+            << "Throughput: " << opsPerSecond << " ops/sec\n"
+            << "Final length: " << stats.finalLength << "\n"
+            << "Checksum: " << std::hex << stats.checksum << std::dec << std::endl;
+    return stats.errors == 0 ? 0 : 2;
+}
+
+int main(int argc, char* argv[]) {
+    std::string replayPath, logPath, recordPath;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            logPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!replayPath.empty()) {
+        return runReplay(replayPath, logPath);
+    }
+
+    std::ofstream record;
+    if (!recordPath.empty()) {
+        record.open(recordPath);
+        if (!record) {
+            std::cerr << "Unable to open record file: " << recordPath << std::endl;
+            return 1;
+        }
+    }
+
+    BufferManager buffers;
+    std::string line;
 
     std::cout << "Simple Text Editor. type 'h' for help.\n";
 
     while (true) {
         std::cout << "> ";
-        std::cin >> command;
+        if (!std::getline(std::cin, line)) break;
+        // Flushed per line so the trace survives a crash
+        if (record.is_open()) record << line << std::endl;
         try {
-            if (command == "i") {
-                std::string text;
-                std::getline(std::cin >> std::ws, text);
-                editor.insertText(text);
-                editor.debugPrint();
-            } else if (command == "d") {
-                int count;
-                std::cin >> count;
-                editor.deleteText(count);
-            } else if (command == "m") {
-                int row, col;
-                std::cin >> row >> col;
-                editor.debugPrint();
-                editor.moveCursor(row, col);
-                editor.debugPrint();
-            } else if (command == "g") {
-                int line;
-                std::cin >> line;
-                editor.goToLine(line);
-            } else if (command == "p") {
-                std::cout << editor.getText() << std::endl;
-            } else if (command == "u") {
-                editor.undo();
-            } else if (command == "r") {
-                editor.redo();
-            } else if (command == "f"){
-                std::string searchStr;
-                std::getline(std::cin >> std::ws, searchStr);
-                auto positions = editor.find(searchStr);
-                std::cout << "Found at positions: ";
-                for (auto pos : positions) std::cout << pos << " ";
-                std::cout << std::endl;
-            } else if (command == "s") {
-                std::string oldStr, newStr;
-                std::cin >> oldStr >> newStr;
-                editor.replace(oldStr, newStr);
-            } else if (command == "o") {
-                std::string filename;
-                std::cin >> filename;
-                editor.loadFile(filename);
-            } else if (command == "w") {
-                std::string filename;
-                std::cin >> filename;
-                editor.saveFile(filename);
-            } else if (command == "q") {
-                break;
-            } else if (command == "h") {
-                printHelp();
-            } else {
-                std::cout << "Unknown command. Type 'h' for help.\n";
-            }
+            if (!runCommandLine(buffers, line)) break;
         } catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << std::endl;
         } catch(...) {
@@ -0,0 +1,197 @@
+#include "marks.h"
+#include <stdexcept>
+
+MarkSet::MarkSet() : root(kNone), count(0), seed(2463534242u) {}
+
+MarkSet::MarkId MarkSet::create(size_t offset, Gravity gravity) {
+    MarkId id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    } else {
+        id = static_cast<MarkId>(nodes.size());
+        nodes.push_back(Node());
+    }
+    // xorshift32; the priorities only need to look random to keep the treap balanced
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    nodes[id].priority = seed;
+    nodes[id].gravity = gravity;
+    link(id, offset);
+    ++count;
+    return id;
+}
+
+void MarkSet::remove(MarkId id) {
+    if (id >= nodes.size()) throw std::out_of_range("Invalid mark");
+    unlink(id);
+    freeIds.push_back(id);
+    --count;
+}
+
+void MarkSet::move(MarkId id, size_t offset) {
+    if (id >= nodes.size()) throw std::out_of_range("Invalid mark");
+    unlink(id);
+    link(id, offset);
+}
+
+size_t MarkSet::offset(MarkId id) const {
+    if (id >= nodes.size()) throw std::out_of_range("Invalid mark");
+    int64_t offset = static_cast<int64_t>(nodes[id].offset);
+    for (uint32_t node = nodes[id].parent; node != kNone; node = nodes[node].parent) {
+        offset += nodes[node].pending;
+    }
+    return static_cast<size_t>(offset);
+}
+
+size_t MarkSet::size() const {
+    return count;
+}
+
+void MarkSet::textInserted(size_t position, size_t length) {
+    if (length == 0 || root == kNone) return;
+
+    uint32_t before, rest, at, after;
+    split(root, position, false, before, rest);
+    split(rest, position, true, at, after);
+    shift(after, static_cast<int64_t>(length));
+
+    // Marks sitting exactly at the insert point go one way or the other
+    // depending on their gravity
+    if (at != kNone) {
+        scratch.clear();
+        collect(at, scratch);
+        for (MarkId id : scratch) {
+            Node& node = nodes[id];
+            node.left = node.right = kNone;
+            if (node.gravity == Gravity::Right) {
+                node.offset = position + length;
+                after = merge(id, after);
+            } else {
+                before = merge(before, id);
+            }
+        }
+    }
+    setRoot(merge(before, after));
+}
+
+void MarkSet::textRemoved(size_t position, size_t length) {
+    if (length == 0 || root == kNone) return;
+
+    uint32_t before, rest, inside, after;
+    split(root, position, true, before, rest);
+    split(rest, position + length, false, inside, after);
+    if (inside != kNone) collapse(inside, position);
+    shift(after, -static_cast<int64_t>(length));
+    setRoot(merge(merge(before, inside), after));
+}
+
+void MarkSet::shift(uint32_t node, int64_t delta) {
+    if (node == kNone) return;
+    nodes[node].offset += delta;
+    nodes[node].pending += delta;
+}
+
+void MarkSet::push(uint32_t node) {
+    Node& n = nodes[node];
+    if (n.pending != 0) {
+        shift(n.left, n.pending);
+        shift(n.right, n.pending);
+        n.pending = 0;
+    }
+}
+
+void MarkSet::split(uint32_t t, uint64_t key, bool inclusive, uint32_t& before, uint32_t& after) {
+    if (t == kNone) {
+        before = after = kNone;
+        return;
+    }
+    push(t);
+    Node& node = nodes[t];
+    if (inclusive ? node.offset <= key : node.offset < key) {
+        split(node.right, key, inclusive, node.right, after);
+        if (node.right != kNone) nodes[node.right].parent = t;
+        before = t;
+    } else {
+        split(node.left, key, inclusive, before, node.left);
+        if (node.left != kNone) nodes[node.left].parent = t;
+        after = t;
+    }
+}
+
+// Every mark in a must be at or before every mark in b
+uint32_t MarkSet::merge(uint32_t a, uint32_t b) {
+    if (a == kNone) return b;
+    if (b == kNone) return a;
+    if (nodes[a].priority > nodes[b].priority) {
+        push(a);
+        uint32_t right = merge(nodes[a].right, b);
+        nodes[a].right = right;
+        nodes[right].parent = a;
+        return a;
+    }
+    push(b);
+    uint32_t left = merge(a, nodes[b].left);
+    nodes[b].left = left;
+    nodes[left].parent = b;
+    return b;
+}
+
+void MarkSet::link(uint32_t node, size_t offset) {
+    Node& n = nodes[node];
+    n.offset = offset;
+    n.pending = 0;
+    n.left = n.right = kNone;
+
+    uint32_t before, after;
+    split(root, offset, true, before, after);
+    setRoot(merge(merge(before, node), after));
+}
+
+void MarkSet::unlink(uint32_t node) {
+    // Pending shifts above the node have to reach its children before they
+    // can be moved up into its place
+    scratch.clear();
+    for (uint32_t p = nodes[node].parent; p != kNone; p = nodes[p].parent) {
+        scratch.push_back(p);
+    }
+    for (auto it = scratch.rbegin(); it != scratch.rend(); ++it) {
+        push(*it);
+    }
+    push(node);
+
+    uint32_t replacement = merge(nodes[node].left, nodes[node].right);
+    uint32_t parent = nodes[node].parent;
+    if (parent == kNone) {
+        setRoot(replacement);
+        return;
+    }
+    if (replacement != kNone) nodes[replacement].parent = parent;
+    if (nodes[parent].left == node) {
+        nodes[parent].left = replacement;
+    } else {
+        nodes[parent].right = replacement;
+    }
+}
+
+void MarkSet::collect(uint32_t t, std::vector<MarkId>& out) {
+    if (t == kNone) return;
+    push(t);
+    collect(nodes[t].left, out);
+    out.push_back(t);
+    collect(nodes[t].right, out);
+}
+
+void MarkSet::collapse(uint32_t t, uint64_t offset) {
+    if (t == kNone) return;
+    nodes[t].offset = offset;
+    nodes[t].pending = 0;
+    collapse(nodes[t].left, offset);
+    collapse(nodes[t].right, offset);
+}
+
+void MarkSet::setRoot(uint32_t node) {
+    root = node;
+    if (node != kNone) nodes[node].parent = kNone;
+}
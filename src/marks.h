@@ -0,0 +1,68 @@
+#ifndef MARKS_H
+#define MARKS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Positions in a document that follow it as it is edited: the cursor,
+// bookmarks, search hits. Marks live in a treap ordered by offset, and a
+// shift is stored once at the root of the subtree it applies to, so an edit
+// costs O(log n) plus the number of marks it lands on, however many marks
+// there are after it.
+class MarkSet {
+public:
+    typedef uint32_t MarkId;
+
+    // Where a mark ends up when text is inserted exactly at its offset
+    enum class Gravity : uint8_t {
+        Left,   // stays before the new text (bookmarks)
+        Right,  // moves past it (the cursor)
+    };
+
+    MarkSet();
+
+    MarkId create(size_t offset, Gravity gravity = Gravity::Left);
+    void remove(MarkId id);
+    void move(MarkId id, size_t offset);
+    size_t offset(MarkId id) const;
+    size_t size() const;
+
+    // Call after the document changed. Marks inside a removed range
+    // collapse to its start.
+    void textInserted(size_t position, size_t length);
+    void textRemoved(size_t position, size_t length);
+
+private:
+    static const uint32_t kNone = UINT32_MAX;
+
+    struct Node {
+        uint64_t offset;   // exact once the pending shifts of all ancestors are added
+        int64_t pending;   // shift not yet passed down to the children
+        uint32_t left;
+        uint32_t right;
+        uint32_t parent;
+        uint32_t priority;
+        Gravity gravity;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<MarkId> freeIds;
+    std::vector<MarkId> scratch;
+    uint32_t root;
+    size_t count;
+    uint32_t seed;
+
+    void shift(uint32_t node, int64_t delta);
+    void push(uint32_t node);
+    // Splits t into marks before key (or at it, if inclusive) and the rest
+    void split(uint32_t t, uint64_t key, bool inclusive, uint32_t& before, uint32_t& after);
+    uint32_t merge(uint32_t a, uint32_t b);
+    void link(uint32_t node, size_t offset);
+    void unlink(uint32_t node);
+    void collect(uint32_t t, std::vector<MarkId>& out);
+    void collapse(uint32_t t, uint64_t offset);
+    void setRoot(uint32_t node);
+};
+
+#endif
@@ -1,24 +1,92 @@
 #include "rope.h"
+#include "intern_table.h"
 #include <algorithm>
+#include <fstream>
 #include <stdexcept>
-#include <iostream>
 
+namespace {
 
-// Node constructor
+// Largest leaf produced by edits; small enough that copying one per keystroke is cheap
+const size_t kMaxLeafSize = 4096;
+// Leaves read from disk in large-file mode, sized for efficient paging
+const size_t kFileLeafSize = 256 * 1024;
 
-Rope::Node::Node(const std::string& str) : left(nullptr), right(nullptr), data(str), weight(str.length()) {}
+} // namespace
 
-Rope::Rope(const std::string& s) : root(std::make_shared<Node>(s)) {}
 
-// Helper func to get character at index
+// Node constructors
+
+Rope::Node::Node(std::shared_ptr<Leaf> leaf)
+    : left(nullptr), right(nullptr), leaf(leaf), length(leaf->length()), newlines(leaf->newlines()), height(1) {}
+
+Rope::Node::Node(std::shared_ptr<Node> left, std::shared_ptr<Node> right)
+    : left(left), right(right), leaf(nullptr),
+      length(left->length + right->length), newlines(left->newlines + right->newlines),
+      height(std::max(left->height, right->height) + 1) {}
+
+Rope::Rope(const std::string& s) {
+    // build() reads cache, so it can only run once every member exists
+    root = build(s);
+}
+
+Rope Rope::fromFile(const std::string& path, size_t cacheBudget) {
+    Rope rope;
+    rope.cache = std::make_shared<LeafCache>(cacheBudget);
+    auto file = BackingFile::open(path);
+
+    // Only the newline counts are kept; the text stays in the file until a leaf is touched
+    std::vector<std::shared_ptr<Node> > leaves;
+    std::string buffer(kFileLeafSize, '\0');
+    for (uint64_t offset = 0; offset < file->size(); offset += kFileLeafSize) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(kFileLeafSize, file->size() - offset));
+        file->read(offset, &buffer[0], chunk);
+        size_t newlines = std::count(buffer.begin(), buffer.begin() + chunk, '\n');
+        leaves.push_back(std::make_shared<Node>(std::make_shared<Leaf>(file, offset, chunk, newlines, rope.cache)));
+    }
+    rope.root = buildBalanced(leaves, 0, leaves.size());
+    return rope;
+}
+
+Rope Rope::paged(size_t cacheBudget) {
+    Rope rope;
+    rope.cache = std::make_shared<LeafCache>(cacheBudget);
+    return rope;
+}
 
-char Rope::index(std::shared_ptr<Node> node, size_t i) const {
-    if (!node) return '\0';
-    if (i < node->weight) {
-        if (node->left) return index(node->left, i);
-        return node->data[i];
+Rope Rope::fromFile(const std::string& path, LeafInternTable& interner) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("Unable to open file");
+
+    std::vector<std::shared_ptr<Node> > leaves;
+    std::string pending;
+    std::vector<char> block(1024 * 1024);
+    bool atEnd = false;
+    while (!atEnd) {
+        file.read(block.data(), block.size());
+        pending.append(block.data(), static_cast<size_t>(file.gcount()));
+        atEnd = !file;
+
+        size_t start = 0;
+        while (start < pending.length()) {
+            size_t chunk = LeafInternTable::chunkLength(pending.data() + start, pending.length() - start, atEnd);
+            if (chunk == 0) break;
+            leaves.push_back(std::make_shared<Node>(interner.intern(pending.data() + start, chunk)));
+            start += chunk;
+        }
+        pending.erase(0, start);
     }
-    return index(node->right, i - node->weight);
+
+    Rope rope;
+    rope.root = buildBalanced(leaves, 0, leaves.size());
+    return rope;
+}
+
+// Helper func to get character at index
+
+char Rope::index(const std::shared_ptr<Node>& node, size_t i) const {
+    if (node->leaf) return (*node->leaf->text())[i];
+    if (i < node->left->length) return index(node->left, i);
+    return index(node->right, i - node->left->length);
 }
 
 // Public indexing operator
@@ -28,149 +96,306 @@ char Rope::operator[](size_t i) const {
     return index(root, i);
 }
 
-// Helper func to concatenate two nodes
+// Helper func to concatenate two nodes, rebalancing along the spine of the taller one
 
 std::shared_ptr<Rope::Node> Rope::concat(std::shared_ptr<Node> left, std::shared_ptr<Node> right) {
     if (!left) return right;
     if (!right) return left;
-    auto newNode = std::make_shared<Node>("");
-    assert(newNode);  // Ensure allocation succeeded
-    newNode->left = left;
-    newNode->right = right;
-    newNode->weight = left->weight;  // Weight should be the weight of the left subtree
-    return newNode;
+
+    // Glue small neighbouring leaves back together so typing doesn't leave a leaf per keystroke
+    if (left->leaf && right->leaf && left->length + right->length <= kMaxLeafSize &&
+        left->leaf->isResident() && right->leaf->isResident()) {
+        return std::make_shared<Node>(std::make_shared<Leaf>(*left->leaf->text() + *right->leaf->text(),
+                                                             left->leaf->cache()));
+    }
+
+    if (left->height > right->height + 1) return balance(left->left, concat(left->right, right));
+    if (right->height > left->height + 1) return balance(concat(left, right->left), right->right);
+    return std::make_shared<Node>(left, right);
 }
 
-// Helper func to split a node ata a given index
-std::pair<std::shared_ptr<Rope::Node>, std::shared_ptr<Rope::Node>> Rope::split(std::shared_ptr<Node> node, size_t i) {
+// Helper func to join two subtrees whose heights differ by at most two
+
+std::shared_ptr<Rope::Node> Rope::balance(std::shared_ptr<Node> left, std::shared_ptr<Node> right) {
+    if (left->height > right->height + 1) {
+        if (left->left->height >= left->right->height) {
+            return std::make_shared<Node>(left->left, std::make_shared<Node>(left->right, right));
+        }
+        auto pivot = left->right;
+        return std::make_shared<Node>(std::make_shared<Node>(left->left, pivot->left),
+                                      std::make_shared<Node>(pivot->right, right));
+    }
+    if (right->height > left->height + 1) {
+        if (right->right->height >= right->left->height) {
+            return std::make_shared<Node>(std::make_shared<Node>(left, right->left), right->right);
+        }
+        auto pivot = right->left;
+        return std::make_shared<Node>(std::make_shared<Node>(left, pivot->left),
+                                      std::make_shared<Node>(pivot->right, right->right));
+    }
+    return std::make_shared<Node>(left, right);
+}
+
+// Helper func to split a node at a given index
+std::pair<std::shared_ptr<Rope::Node>, std::shared_ptr<Rope::Node>> Rope::split(const std::shared_ptr<Node>& node, size_t i) const {
     if (!node) return {nullptr, nullptr};
     if (i == 0) return {nullptr, node};
+    if (i >= node->length) return {node, nullptr};
 
-    size_t leftWeight = node->left ? node->left->weight : 0;
+    if (node->leaf) {
+        return {std::make_shared<Node>(node->leaf->slice(0, i)),
+                std::make_shared<Node>(node->leaf->slice(i, node->length))};
+    }
 
-    if (i <= leftWeight) {
+    size_t leftLength = node->left->length;
+    if (i < leftLength) {
         auto [left, right] = split(node->left, i);
-        node->left = right;
-        node->weight = (right ? right->weight : 0) + node->data.length() + (node->right ? node->right->weight : 0);
-        return {left, node};
-    } else if (i < node->weight) {
-        size_t splitPoint = i - leftWeight;
-        auto newLeft = std::make_shared<Node>(node->data.substr(0, splitPoint));
-        newLeft->left = node->left;
-        newLeft->weight = leftWeight + splitPoint;
-        
-        node->data = node->data.substr(splitPoint);
-        node->left = nullptr;
-        node->weight -= i;
-        
-        return {newLeft, node};
+        return {left, concat(right, node->right)};
+    } else if (i == leftLength) {
+        return {node->left, node->right};
     } else {
-        auto [left, right] = split(node->right, i - node->weight);
-        node->right = left;
-        node->weight += (left ? left->weight : 0);
-        return {node, right};
+        auto [left, right] = split(node->right, i - leftLength);
+        return {concat(node->left, left), right};
     }
 }
 
-// Helper func to insert a string at a given index
-void Rope::insert(std::shared_ptr<Node>& node, size_t i, const std::string& str) {
-    std::cout << "Inserting '" << str << "' at index " << i << std::endl;
-    std::cout << "Current rope content: " << to_string() << std::endl;
-
-    auto [left, right] = split(node, i);
-    auto strNode = std::make_shared<Node>(str);
-    strNode->weight = str.length();
-    auto leftConcat = concat(left, strNode);
-    node = concat(leftConcat, right);
-    std::cout << "After insertion: " << to_string() << std::endl;
-
+// Helper func to insert into the leaf holding index i when the result still
+// fits in one leaf. Returns null when the tree has to be split instead.
+std::shared_ptr<Rope::Node> Rope::insertInLeaf(const std::shared_ptr<Node>& node, size_t i, std::string_view str) const {
+    if (node->leaf) {
+        if (node->length + str.length() > kMaxLeafSize) return nullptr;
+        std::string merged = *node->leaf->text();
+        merged.insert(i, str);
+        return makeLeaf(std::move(merged));
+    }
+    size_t leftLength = node->left->length;
+    if (i <= leftLength) {
+        auto left = insertInLeaf(node->left, i, str);
+        return left ? std::make_shared<Node>(left, node->right) : nullptr;
+    }
+    auto right = insertInLeaf(node->right, i - leftLength, str);
+    return right ? std::make_shared<Node>(node->left, right) : nullptr;
 }
 
 //Public insert func
-void Rope::insert(size_t i, const std::string& str) {
+void Rope::insert(size_t i, std::string_view str) {
     if (i > length()) throw std::out_of_range("Index out of range");
-    insert(root, i , str);
+    if (str.empty()) return;
+    if (root) {
+        if (auto updated = insertInLeaf(root, i, str)) {
+            root = updated;
+            return;
+        }
+    }
+    auto [left, right] = split(root, i);
+    root = concat(concat(left, build(str)), right);
 }
 
-// Helper func to remove a range of characters
+void Rope::append(const std::vector<std::shared_ptr<Leaf> >& leaves) {
+    std::vector<std::shared_ptr<Node> > nodes;
+    for (const auto& leaf : leaves) {
+        if (leaf->length() > 0) nodes.push_back(std::make_shared<Node>(leaf));
+    }
+    root = concat(root, buildBalanced(nodes, 0, nodes.size()));
+}
 
-void Rope::remove(std::shared_ptr<Node>& node, size_t i , size_t j) {
-    auto [left, temp] = split(node, i);
-    auto [_, right] = split(temp, j - i);
-    node = concat(left, right);
+// Helper func to remove [i, j) when it lies inside a single small leaf and
+// leaves part of it behind. Returns null when the tree has to be split
+// instead, which for big (e.g. file-backed) leaves keeps the pieces as
+// slices of the original rather than copying it.
+std::shared_ptr<Rope::Node> Rope::removeInLeaf(const std::shared_ptr<Node>& node, size_t i, size_t j) const {
+    if (node->leaf) {
+        if (j - i >= node->length || node->length > kMaxLeafSize) return nullptr;
+        std::string rest = *node->leaf->text();
+        rest.erase(i, j - i);
+        return makeLeaf(std::move(rest));
+    }
+    size_t leftLength = node->left->length;
+    if (j <= leftLength) {
+        auto left = removeInLeaf(node->left, i, j);
+        return left ? std::make_shared<Node>(left, node->right) : nullptr;
+    }
+    if (i >= leftLength) {
+        auto right = removeInLeaf(node->right, i - leftLength, j - leftLength);
+        return right ? std::make_shared<Node>(node->left, right) : nullptr;
+    }
+    return nullptr;
 }
 
 // Public remove func
 
 void Rope::remove(size_t i, size_t j) {
     if (i >= length() || j > length() || i > j) throw std::out_of_range("Invalid range");
-    remove(root, i , j);
+    if (i == j) return;
+    if (auto updated = removeInLeaf(root, i, j)) {
+        root = updated;
+        return;
+    }
+    auto [left, temp] = split(root, i);
+    auto [_, right] = split(temp, j - i);
+    root = concat(left, right);
 }
 
-
-// Public substring func
-std::string Rope::substring(std::shared_ptr<Node> node, size_t i, size_t j) const {
-    if (!node) return "";
-    if (i >= node->weight) return substring(node->right, i - node->weight, j - node->weight);
-    if (j <= node->weight) {
-        if (node->left) return substring(node->left, i, j);
-        return node->data.substr(i, j - i);
+void Rope::forEachChunk(const std::shared_ptr<Node>& node, size_t i, size_t j,
+                        const std::function<void(const char*, size_t)>& visit) const {
+    if (!node || i >= j) return;
+    if (node->leaf) {
+        auto text = node->leaf->text();
+        visit(text->data() + i, j - i);
+        return;
     }
-    return substring(node->left, i, node->weight) + substring(node->right, 0, j - node->weight);
+    size_t leftLength = node->left->length;
+    if (i < leftLength) forEachChunk(node->left, i, std::min(j, leftLength), visit);
+    if (j > leftLength) forEachChunk(node->right, i > leftLength ? i - leftLength : 0, j - leftLength, visit);
 }
 
+void Rope::forEachChunk(size_t i, size_t j, const std::function<void(const char*, size_t)>& visit) const {
+    if (i > j || j > length()) throw std::out_of_range("Invalid range");
+    forEachChunk(root, i, j, visit);
+}
+
+// Public substring func
 std::string Rope::substring(size_t i, size_t j) const {
-    if (i >= length() || j > length() || i > j) throw std::out_of_range("Invalid range");
-    return substring(root, i, j);
+    if (i > j || j > length()) throw std::out_of_range("Invalid range");
+    std::string result;
+    result.reserve(j - i);
+    forEachChunk(root, i, j, [&](const char* data, size_t count) { result.append(data, count); });
+    return result;
 }
 
 // public length func
 size_t Rope::length() const {
-    return lengthRecursive(root);
-}
-
-size_t Rope::lengthRecursive(const std::shared_ptr<Node>& node) const {
-    if (!node) return 0;
-    return node->weight + lengthRecursive(node->right);
+    return root ? root->length : 0;
 }
 
 std::string Rope::to_string() const {
-    std::string result;
-    to_string_recursive(root, result);
-    return result;
+    return substring(0, length());
 }
 
 size_t Rope::countLines() const {
-    return countLinesRecursive(root) + 1;
+    return (root ? root->newlines : 0) + 1;
 }
 
-size_t Rope::countLinesRecursive(const std::shared_ptr<Node>& node) const {
-    if (!node) return 0;
-    size_t count = std::count(node->data.begin(), node->data.end(), '\n');
-    return count + countLinesRecursive(node->left) + countLinesRecursive(node->right);
+// Offset of the first character of a line, found by descending on newline counts
+size_t Rope::lineStart(size_t line) const {
+    if (line == 0) return 0;
+    if (line >= countLines()) throw std::out_of_range("Line is out of range");
+
+    size_t offset = 0;
+    size_t remaining = line;
+    std::shared_ptr<Node> node = root;
+    while (!node->leaf) {
+        if (remaining <= node->left->newlines) {
+            node = node->left;
+        } else {
+            remaining -= node->left->newlines;
+            offset += node->left->length;
+            node = node->right;
+        }
+    }
+    auto text = node->leaf->text();
+    size_t pos = 0;
+    for (; pos < text->length(); ++pos) {
+        if ((*text)[pos] == '\n' && --remaining == 0) break;
+    }
+    return offset + pos + 1;
 }
 
-void Rope::to_string_recursive(const std::shared_ptr<Node>& node, std::string& result) const {
-    if (!node) return;
-    to_string_recursive(node->left, result);
-    result += node->data;
-    to_string_recursive(node->right, result);
+// Line containing a position, i.e. the number of newlines before it
+size_t Rope::lineOf(size_t position) const {
+    if (position > length()) throw std::out_of_range("Index out of range");
+
+    size_t line = 0;
+    std::shared_ptr<Node> node = root;
+    while (node && !node->leaf) {
+        if (position < node->left->length) {
+            node = node->left;
+        } else {
+            line += node->left->newlines;
+            position -= node->left->length;
+            node = node->right;
+        }
+    }
+    if (node && position > 0) {
+        auto text = node->leaf->text();
+        line += std::count(text->begin(), text->begin() + position, '\n');
+    }
+    return line;
+}
+
+std::shared_ptr<Rope::Node> Rope::makeLeaf(std::string str) const {
+    return std::make_shared<Node>(std::make_shared<Leaf>(std::move(str), cache));
 }
-// Helper func for rebalancing
 
+std::shared_ptr<Rope::Node> Rope::build(std::string_view s) const {
+    std::vector<std::shared_ptr<Node> > leaves;
+    for (size_t start = 0; start < s.length(); start += kMaxLeafSize) {
+        leaves.push_back(makeLeaf(std::string(s.substr(start, kMaxLeafSize))));
+    }
+    return buildBalanced(leaves, 0, leaves.size());
+}
 
-std::shared_ptr<Rope::Node> Rope::rebalance_helper(const std::string& s, size_t start, size_t end) {
+// Helper func for rebalancing
+
+std::shared_ptr<Rope::Node> Rope::buildBalanced(const std::vector<std::shared_ptr<Node> >& leaves, size_t start, size_t end) {
     if (start >= end) return nullptr;
+    if (end - start == 1) return leaves[start];
     size_t mid = (start + end) / 2;
-    auto node = std::make_shared<Node>(s.substr(start, mid - start));
-    node->left = rebalance_helper(s, start, mid);
-    node->right = rebalance_helper(s, mid, end);
-    node->weight = mid - start + (node->left ? node->left->weight : 0);
-    return node;
+    return std::make_shared<Node>(buildBalanced(leaves, start, mid), buildBalanced(leaves, mid, end));
 }
 
+void Rope::collectLeaves(const std::shared_ptr<Node>& node, std::vector<std::shared_ptr<Node> >& leaves) {
+    if (!node) return;
+    if (node->leaf) {
+        leaves.push_back(node);
+        return;
+    }
+    collectLeaves(node->left, leaves);
+    collectLeaves(node->right, leaves);
+}
 
 void Rope::rebalance() {
-    std::string s = to_string();
-    root = rebalance_helper(s, 0, s.length());
-}
\ No newline at end of file
+    std::vector<std::shared_ptr<Node> > leaves;
+    collectLeaves(root, leaves);
+    root = buildBalanced(leaves, 0, leaves.size());
+}
+
+void Rope::countNodes(const std::shared_ptr<Node>& node, size_t& count) {
+    if (!node) return;
+    ++count;
+    countNodes(node->left, count);
+    countNodes(node->right, count);
+}
+
+Rope::MemoryUsage Rope::memoryUsage() const {
+    MemoryUsage usage = {0, 0, 0, 0, 0};
+    countNodes(root, usage.nodes);
+    // make_shared puts the reference counts in the same allocation as the node
+    usage.nodeBytes = usage.nodes * (sizeof(Node) + 2 * sizeof(long));
+    visitLeaves([&](const std::shared_ptr<Leaf>& leaf) {
+        ++usage.leaves;
+        if (!leaf->isResident()) return;
+        usage.leafBytes += leaf->length();
+        if (leaf.use_count() > 1) usage.sharedLeafBytes += leaf->length();
+    });
+    return usage;
+}
+
+void Rope::visitLeaves(const std::function<void(const std::shared_ptr<Leaf>&)>& visit) const {
+    std::vector<std::shared_ptr<Node> > leaves;
+    collectLeaves(root, leaves);
+    for (const auto& node : leaves) visit(node->leaf);
+}
+
+bool Rope::isPaged() const {
+    return cache != nullptr;
+}
+
+const std::shared_ptr<LeafCache>& Rope::leafCache() const {
+    return cache;
+}
+
+LeafCache::Stats Rope::cacheStats() const {
+    if (!cache) return {0, 0, 0, 0, 0, 0};
+    return cache->stats();
+}
@@ -1,51 +1,103 @@
 #ifndef ROPE_H
 #define ROPE_H
 
+#include "leaf_cache.h"
+
+#include <functional>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <vector>
+
+class LeafInternTable;
 
+// Height-balanced rope. Nodes are never modified once built, so edits copy
+// only the path from the root to the changed leaves and copies of a Rope share
+// structure. Every node keeps the length and newline count of its subtree,
+// which is all that has to stay in memory when leaves are paged out.
 class Rope {
 private:
 
     struct Node {
         std::shared_ptr<Node> left, right;
-        std::string data;
-        size_t weight;
+        std::shared_ptr<Leaf> leaf;  // set on leaves only
+        size_t length;
+        size_t newlines;
+        int height;
 
-        Node(const std::string& str);
+        explicit Node(std::shared_ptr<Leaf> leaf);
+        Node(std::shared_ptr<Node> left, std::shared_ptr<Node> right);
     };
 
     std::shared_ptr<Node> root;
+    std::shared_ptr<LeafCache> cache;  // only set in large-file mode
 
     // Helper functions
 
-    char index(std::shared_ptr<Node> node, size_t i) const;
-    std::shared_ptr<Node> concat(std::shared_ptr<Node> left, std::shared_ptr<Node> right);
-    std::pair<std::shared_ptr<Node>, std::shared_ptr<Node> > split(std::shared_ptr<Node> node, size_t i);
-    void insert(std::shared_ptr<Node>& node, size_t i, const std::string& str);
-    void remove(std::shared_ptr<Node>& node, size_t i, size_t j);
-    std::string substring(std::shared_ptr<Node> node, size_t i, size_t j) const;
-    std::shared_ptr<Node> rebalance_helper(const std::string& s, size_t start, size_t end);
-    size_t lengthRecursive(const std::shared_ptr<Node>& node) const;
-    void to_string_recursive(const std::shared_ptr<Node>& node, std::string& result) const;
-    size_t countLinesRecursive(const std::shared_ptr<Node>& node) const;
+    char index(const std::shared_ptr<Node>& node, size_t i) const;
+    static std::shared_ptr<Node> concat(std::shared_ptr<Node> left, std::shared_ptr<Node> right);
+    static std::shared_ptr<Node> balance(std::shared_ptr<Node> left, std::shared_ptr<Node> right);
+    std::pair<std::shared_ptr<Node>, std::shared_ptr<Node> > split(const std::shared_ptr<Node>& node, size_t i) const;
+    std::shared_ptr<Node> insertInLeaf(const std::shared_ptr<Node>& node, size_t i, std::string_view str) const;
+    std::shared_ptr<Node> removeInLeaf(const std::shared_ptr<Node>& node, size_t i, size_t j) const;
+    void forEachChunk(const std::shared_ptr<Node>& node, size_t i, size_t j,
+                      const std::function<void(const char*, size_t)>& visit) const;
+    std::shared_ptr<Node> makeLeaf(std::string str) const;
+    std::shared_ptr<Node> build(std::string_view s) const;
+    static std::shared_ptr<Node> buildBalanced(const std::vector<std::shared_ptr<Node> >& leaves, size_t start, size_t end);
+    static void collectLeaves(const std::shared_ptr<Node>& node, std::vector<std::shared_ptr<Node> >& leaves);
+    static void countNodes(const std::shared_ptr<Node>& node, size_t& count);
 
 public:
 
-    size_t countLines() const;
+    struct MemoryUsage {
+        size_t nodes;
+        size_t leaves;
+        size_t leafBytes;        // resident text held by this rope's leaves
+        size_t sharedLeafBytes;  // part of leafBytes in leaves other ropes use too
+        size_t nodeBytes;        // tree structure, not counting the leaves
+    };
+
     Rope(const std::string& s = "");
 
+    // Large-file mode: leaves are read from path on demand and at most
+    // cacheBudget bytes of them are kept in memory
+    static Rope fromFile(const std::string& path, size_t cacheBudget);
+    // Empty large-file mode rope, to be filled with append()
+    static Rope paged(size_t cacheBudget);
+
+    // Builds the rope from content-defined chunks of the file, reusing any
+    // identical leaf already in the intern table
+    static Rope fromFile(const std::string& path, LeafInternTable& interner);
+
     //Public interface
     char operator[](size_t i) const;
-    void insert(size_t i, const std::string& str);
+    void insert(size_t i, std::string_view str);
     void remove(size_t i, size_t j);
+    // Adds prebuilt leaves at the end, e.g. as a file streams in
+    void append(const std::vector<std::shared_ptr<Leaf> >& leaves);
     std::string substring(size_t i, size_t j) const;
     size_t length() const;
+    size_t countLines() const;
+
+    // Line index, answered from the per-node newline counts
+    size_t lineStart(size_t line) const;
+    size_t lineOf(size_t position) const;
+
+    // Calls visit with each piece of [i, j) in order, one leaf at a time
+    void forEachChunk(size_t i, size_t j, const std::function<void(const char*, size_t)>& visit) const;
 
     // Additional methods
     std::string to_string() const;
     void rebalance();
 
+    bool isPaged() const;
+    const std::shared_ptr<LeafCache>& leafCache() const;
+    LeafCache::Stats cacheStats() const;
+
+    MemoryUsage memoryUsage() const;
+    void visitLeaves(const std::function<void(const std::shared_ptr<Leaf>&)>& visit) const;
+
 };
 
 
@@ -53,4 +105,4 @@ public:
 
 
 
-#endif 
\ No newline at end of file
+#endif
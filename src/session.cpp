@@ -0,0 +1,300 @@
+#include "session.h"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+
+namespace {
+
+// Stream buffer that swallows everything written to it
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Points std::cout and std::cerr at another buffer for the lifetime of the guard
+class OutputRedirect {
+    std::streambuf* oldOut;
+    std::streambuf* oldErr;
+public:
+    explicit OutputRedirect(std::streambuf* target)
+        : oldOut(std::cout.rdbuf(target)), oldErr(std::cerr.rdbuf(target)) {}
+    ~OutputRedirect() {
+        std::cout.rdbuf(oldOut);
+        std::cerr.rdbuf(oldErr);
+    }
+};
+
+bool isBlankOrComment(const std::string& line) {
+    size_t first = line.find_first_not_of(" \t\r");
+    return first == std::string::npos || line[first] == '#';
+}
+
+const char* colorFor(TokenType type) {
+    switch (type) {
+        case TokenType::Keyword: return "\033[34m";
+        case TokenType::String: return "\033[32m";
+        case TokenType::Number: return "\033[35m";
+        case TokenType::Comment: return "\033[90m";
+        case TokenType::Preprocessor: return "\033[33m";
+    }
+    return "";
+}
+
+void printHighlighted(const HighlightedLine& line) {
+    size_t pos = 0;
+    for (const auto& span : line.spans) {
+        std::cout << line.text.substr(pos, span.start - pos) << colorFor(span.type)
+                << line.text.substr(span.start, span.length) << "\033[0m";
+        pos = span.start + span.length;
+    }
+    std::cout << line.text.substr(pos) << "\n";
+}
+
+} // namespace
+
+void printHelp() {
+    std::cout << "Available commands: \n"
+            << " i <text> - Insert text at cursor\n"
+            << " d <n> - Delete n characters from cursor\n"
+            << " m <row> <col> - Move cursor\n"
+            << " g <line> - Go to line\n"
+            << " p - Print current text\n"
+            << " u - Undo\n"
+            << " r - Redo\n"
+            << " f <text> - Find text and remember the hits\n"
+            << " N - Move cursor to the next search hit\n"
+            << " M [name] - Set a bookmark at the cursor, or list bookmarks\n"
+            << " G <name> - Move cursor to a bookmark\n"
+            << " s <old> <new> - Replace text\n"
+            << " o <filename> - Open file\n"
+            << " w <filename> - Write to file\n"
+            << " j <filename> - Open file with edit journal (recovers unsaved edits)\n"
+            << " c - Checkpoint journaled edits into the file\n"
+            << " l <filename> <MB> - Open large file, keeping at most <MB> of it in memory\n"
+            << " a <filename> [MB] - Open file in the background, paged to <MB> if given\n"
+            << " n [cancel] - Show background load progress, or stop the load\n"
+            << " k - Show large-file cache statistics\n"
+            << " v - Show the lines in the viewport\n"
+            << " t <cpp|off> - Set syntax highlighting\n"
+            << " y [line] - Show the viewport highlighted, optionally scrolled to line\n"
+            << " e <filename> - Open file in a new buffer\n"
+            << " b - List buffers, memory usage and undo history size\n"
+            << " x <id> - Switch to buffer\n"
+            << " z - Close current buffer\n"
+            << " q - Quit\n"
+            << " h - Show this help\n";
+}
+
+namespace {
+
+void printBuffers(const BufferManager& buffers) {
+    for (const auto& info : buffers.list()) {
+        std::cout << (info.id == buffers.currentId() ? "* " : "  ") << info.id << " " << info.name
+                << ": " << info.length << " bytes, " << info.memory.leaves << " leaves, "
+                << info.memory.sharedLeafBytes << " bytes shared, "
+                << info.attributedBytes << " bytes attributed\n";
+    }
+    BufferManager::Totals totals = buffers.totals();
+    LeafInternTable::Stats intern = buffers.internStats();
+    std::cout << "Total: " << totals.buffers << " buffers, " << totals.documentBytes << " bytes of text stored in "
+            << totals.storedBytes << " bytes (" << totals.leaves << " distinct leaves, "
+            << totals.overheadBytes << " bytes overhead)\n"
+            << "Intern table: " << intern.hits << " of " << intern.lookups << " chunks deduplicated" << std::endl;
+}
+
+} // namespace
+
+bool runCommandLine(BufferManager& buffers, const std::string& line, bool headless) {
+    TextEditor& editor = buffers.current();
+    // Bring in whatever a background load has read since the last command
+    editor.pumpLoad();
+    std::istringstream args(line);
+    std::string command;
+    if (!(args >> command)) return true;
+
+    if (command == "i") {
+        std::string text;
+        std::getline(args >> std::ws, text);
+        editor.insertText(text);
+        if (!headless) editor.debugPrint();
+    } else if (command == "d") {
+        int count;
+        args >> count;
+        editor.deleteText(count);
+    } else if (command == "m") {
+        int row, col;
+        args >> row >> col;
+        if (!headless) editor.debugPrint();
+        editor.moveCursor(row, col);
+        if (!headless) editor.debugPrint();
+    } else if (command == "g") {
+        int line;
+        args >> line;
+        editor.goToLine(line);
+    } else if (command == "p") {
+        std::cout << editor.getText() << std::endl;
+    } else if (command == "u") {
+        editor.undo();
+    } else if (command == "r") {
+        editor.redo();
+    } else if (command == "f"){
+        std::string searchStr;
+        std::getline(args >> std::ws, searchStr);
+        auto positions = editor.markSearchHits(searchStr);
+        std::cout << "Found at positions: ";
+        for (auto pos : positions) std::cout << pos << " ";
+        std::cout << std::endl;
+    } else if (command == "N") {
+        if (!editor.nextSearchHit()) std::cout << "No search hits. Use 'f' first.\n";
+        std::cout << "Cursor at line " << editor.getCurrentLine() << ", column "
+                << editor.getCurrentColumn() << std::endl;
+    } else if (command == "M") {
+        std::string name;
+        if (args >> name) {
+            editor.setBookmark(name);
+        } else {
+            for (const auto& bookmark : editor.getBookmarks()) {
+                std::cout << bookmark.first << ": " << bookmark.second << "\n";
+            }
+            std::cout << std::flush;
+        }
+    } else if (command == "G") {
+        std::string name;
+        args >> name;
+        editor.jumpToBookmark(name);
+        std::cout << "Cursor at line " << editor.getCurrentLine() << ", column "
+                << editor.getCurrentColumn() << std::endl;
+    } else if (command == "s") {
+        std::string oldStr, newStr;
+        args >> oldStr >> newStr;
+        editor.replace(oldStr, newStr);
+    } else if (command == "o") {
+        std::string filename;
+        args >> filename;
+        editor.loadFile(filename);
+        if (!headless) std::cout << "File content read: " << editor.getRope().to_string() << std::endl;
+    } else if (command == "w") {
+        std::string filename;
+        args >> filename;
+        editor.saveFile(filename);
+    } else if (command == "j") {
+        std::string filename;
+        args >> filename;
+        editor.openJournaled(filename);
+    } else if (command == "c") {
+        editor.checkpoint();
+    } else if (command == "l") {
+        std::string filename;
+        size_t megabytes = 64;
+        args >> filename >> megabytes;
+        editor.loadLargeFile(filename, megabytes * 1024 * 1024);
+    } else if (command == "a") {
+        std::string filename;
+        size_t megabytes = 0;
+        args >> filename >> megabytes;
+        editor.openAsync(filename, megabytes * 1024 * 1024);
+        // A replay must not depend on how far the loader got between commands
+        if (headless) editor.finishLoad();
+    } else if (command == "n") {
+        std::string action;
+        if (args >> action && action == "cancel") editor.cancelLoad();
+        LoadProgress progress = editor.getLoadProgress();
+        std::cout << (progress.loading ? "Loading: " : "Loaded: ") << progress.bytesLoaded
+                << " / " << progress.totalBytes << " bytes, " << editor.getTotalLines()
+                << " lines" << std::endl;
+    } else if (command == "k") {
+        LeafCache::Stats stats = editor.getCacheStats();
+        std::cout << "Cache hits: " << stats.hits << ", misses: " << stats.misses
+                << ", evictions: " << stats.evictions << "\n"
+                << "Resident: " << stats.residentBytes << " / " << stats.budgetBytes
+                << " bytes, swap: " << stats.swapBytes << " bytes" << std::endl;
+    } else if (command == "v") {
+        for (const auto& viewportLine : editor.getViewportContent()) {
+            std::cout << viewportLine << "\n";
+        }
+        std::cout << std::flush;
+    } else if (command == "t") {
+        std::string language;
+        args >> language;
+        if (language == "cpp") {
+            editor.setTokenizer(std::make_unique<CppTokenizer>());
+        } else if (language == "off") {
+            editor.setTokenizer(nullptr);
+        } else {
+            std::cout << "Unknown language. Use 'cpp' or 'off'.\n";
+        }
+    } else if (command == "y") {
+        size_t line;
+        if (args >> line) editor.scrollTo(line);
+        for (const auto& highlighted : editor.getHighlightedViewport()) {
+            printHighlighted(highlighted);
+        }
+        std::cout << "(" << editor.takeLinesRelexed() << " lines lexed)" << std::endl;
+    } else if (command == "e") {
+        std::string filename;
+        args >> filename;
+        buffers.open(filename);
+    } else if (command == "b") {
+        printBuffers(buffers);
+        EditLog::Stats history = editor.getHistoryStats();
+        std::cout << "Undo history: " << history.entries << " edits (" << history.undoable
+                << " undoable), " << history.recordBytes + history.textBytes << " bytes" << std::endl;
+    } else if (command == "x") {
+        size_t id;
+        args >> id;
+        buffers.switchTo(id);
+    } else if (command == "z") {
+        buffers.close(buffers.currentId());
+    } else if (command == "q") {
+        return false;
+    } else if (command == "h") {
+        printHelp();
+    } else {
+        std::cout << "Unknown command. Type 'h' for help.\n";
+    }
+    return true;
+}
+
+ReplayStats replaySession(BufferManager& buffers, std::istream& script, std::ostream* log) {
+    // Read the whole script up front so file I/O is not part of the measurement
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(script, line)) {
+        if (!isBlankOrComment(line)) lines.push_back(line);
+    }
+
+    ReplayStats stats = {0, 0, 0.0, 0, 0};
+    NullBuffer discard;
+    {
+        OutputRedirect redirect(log ? log->rdbuf() : &discard);
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& command : lines) {
+            ++stats.operations;
+            try {
+                if (!runCommandLine(buffers, command, true)) break;
+            } catch (const std::exception& e) {
+                ++stats.errors;
+                std::cerr << "Error at operation " << stats.operations << ": " << e.what() << std::endl;
+            } catch (...) {
+                ++stats.errors;
+                std::cerr << "Unknown error at operation " << stats.operations << std::endl;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        stats.seconds = std::chrono::duration<double>(end - start).count();
+    }
+
+    // In large-file mode reading the document can itself fail (e.g. the swap
+    // file can't be written); report it like any other error
+    try {
+        stats.checksum = buffers.current().checksum();
+    } catch (const std::exception& e) {
+        ++stats.errors;
+        std::cerr << "Error computing checksum: " << e.what() << std::endl;
+    }
+    stats.finalLength = buffers.current().getTextLength();
+    return stats;
+}
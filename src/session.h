@@ -0,0 +1,32 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "buffer_manager.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Result of replaying an edit script without a terminal attached
+struct ReplayStats {
+    size_t operations;
+    size_t errors;
+    double seconds;
+    uint64_t checksum;
+    size_t finalLength;
+};
+
+void printHelp();
+
+// Runs a single command line ("i hello", "m 1 0", ...) against the current
+// buffer. Returns false when the line asks to quit. Errors are reported by throwing.
+// Headless runs skip the debug dumps of the whole document.
+bool runCommandLine(BufferManager& buffers, const std::string& line, bool headless = false);
+
+// Applies every command in the script as fast as possible. All output the
+// commands produce goes to log (or is dropped when log is null), so the
+// timing only covers the editing work itself.
+ReplayStats replaySession(BufferManager& buffers, std::istream& script, std::ostream* log);
+
+#endif
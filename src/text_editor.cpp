@@ -1,49 +1,32 @@
 #include "text_editor.h"
-#include "command.h"
+#include "journal.h"
 #include <fstream>
 #include <algorithm>
 #include <stdexcept>
 
-class InsertCommand : public Command {
-    TextEditor& editor;
-    std::string text;
-    size_t position;
-
-public:
-    InsertCommand(TextEditor& editor, const std::string& t, size_t pos): editor(editor), text(t), position(pos) {}
-    void execute() override { editor.insertTextAt(text, position); }
-    void undo() override { editor.deleteTextAt(text.length(), position) ; }
-};
-
-class DeleteCommand : public Command {
-    TextEditor& editor;
-    std::string deletedText;
-    size_t position;
-public: 
-    DeleteCommand(TextEditor& e, size_t count, size_t pos) : editor(e), position(pos) {
-        deletedText = editor.getTextAt(pos, count);
-        std::cout << "DELETED TEXT: " << deletedText << std::endl;
-    }
-    void execute() override { editor.deleteTextAt(deletedText.length(), position); }
-    void undo() override { editor.insertTextAt(deletedText, position); }
-};
+namespace {
+
+// Journal size at which edits are folded back into the base file
+const uint64_t kCheckpointThreshold = 64 * 1024 * 1024;
+
+} // namespace
+
+TextEditor::TextEditor() : cursor(marks), viewportStart(0), viewportHeight(25), wordWrapEnabled(false), loadedBytes(0), loadTotalBytes(0) {}
 
-TextEditor::TextEditor() : viewportStart(0), viewportHeight(25), wordWrapEnabled(false) {}
+TextEditor::~TextEditor() = default;
 
 void TextEditor::insertChar(char c) {
-    size_t pos = cursor.getGlobalPosition(text);
+    size_t pos = cursor.getGlobalPosition();
     if (pos <= text.length()) {
-        std::string str(1, c);
-        executeCommand(std::make_unique<InsertCommand>(*this, str, pos));
+        applyInsert(std::string(1, c), pos);
     } else {
         std::cout << "Error: Invalid cursor position for insertion." << std::endl;
     }
 }
 
 void TextEditor::deleteChar() {
-    if (cursor.getGlobalPosition(text) > 0) {
-        executeCommand(std::make_unique<DeleteCommand>(*this, 1, cursor.getGlobalPosition(text) - 1));
-        cursor.moveLeft(text);
+    if (cursor.getGlobalPosition() > 0) {
+        applyDelete(1, cursor.getGlobalPosition() - 1);
     }
 }
 
@@ -66,18 +49,16 @@ void TextEditor::moveCursor(int rowDelta, int colDelta) {
 }
 
 void TextEditor::goToLine(size_t lineNumber) {
-    size_t currentLine = cursor.getRow();
-    moveCursor(static_cast<int>(lineNumber) - static_cast<int>(currentLine), 0);
     cursor.setPosition(text, lineNumber, 0);
 }
 
 void TextEditor::insertText(const std::string& str) {
-    size_t pos = cursor.getGlobalPosition(text);
+    size_t pos = cursor.getGlobalPosition();
     if (pos <= text.length()) {
         try {
-            executeCommand(std::make_unique<InsertCommand>(*this, str, pos));
+            applyInsert(str, pos);
         } catch (const std::exception& e) {
-            std::cerr << "Error in executeCommand: " << e.what() << std::endl;
+            std::cerr << "Error in applyInsert: " << e.what() << std::endl;
         }
     } else {
         std::cout << "Error: Invalid cursor position for insertion." << std::endl;
@@ -85,12 +66,10 @@ void TextEditor::insertText(const std::string& str) {
 }
 
 void TextEditor::deleteText(size_t count) {
-    size_t pos = cursor.getGlobalPosition(text);
+    size_t pos = cursor.getGlobalPosition();
     if ( pos >= count) {
-        executeCommand(std::make_unique<DeleteCommand>(*this, count, pos - count));
-        for (size_t i = 0; i < count; ++i){
-            cursor.moveLeft(text);
-        }
+        // The cursor is a mark, so it ends up where the deleted text began
+        applyDelete(count, pos - count);
     }
 }
 
@@ -105,46 +84,73 @@ std::string TextEditor::getText() const {
 }
 
 std::string TextEditor::getLine(size_t lineNumber) const {
-    size_t start = 0;
-    for (size_t i = 0; i < lineNumber; ++i) {
-        start = text.substring(start, text.length()).find('\n') + 1 + start;
-    }
-    size_t end = text.substring(start, text.length()).find('\n');
-    if (end == std::string::npos) {
-        end = text.length();
-    } else {
-        end += start;
-    }
+    size_t start = text.lineStart(lineNumber);
+    size_t end = lineNumber + 1 < text.countLines() ? text.lineStart(lineNumber + 1) - 1 : text.length();
     return text.substring(start, end);
 }
 
 void TextEditor::undo() {
-    if (!undoStack.empty()) {
-        auto command = std::move(undoStack.back());
-        undoStack.pop_back();
-        command->undo();
-        redoStack.push_back(std::move(command));
+    if (history.canUndo()) {
+        EditLog::Step step = history.undo();
+        try {
+            if (step.op == EditLog::Op::Insert) {
+                insertTextAt(step.text, step.position);
+            } else {
+                deleteTextAt(step.text.size(), step.position);
+            }
+        } catch (...) {
+            // Nothing was applied, so the record is still the one to undo
+            history.redo();
+            throw;
+        }
+        checkpointIfJournalFull();
     }
 }
 
 void TextEditor::redo() {
-    if (!redoStack.empty()) {
-        auto command = std::move(redoStack.back());
-        redoStack.pop_back();
-        command->execute();
-        undoStack.push_back(std::move(command));
+    if (history.canRedo()) {
+        EditLog::Step step = history.redo();
+        try {
+            if (step.op == EditLog::Op::Insert) {
+                insertTextAt(step.text, step.position);
+            } else {
+                deleteTextAt(step.text.size(), step.position);
+            }
+        } catch (...) {
+            history.undo();
+            throw;
+        }
+        checkpointIfJournalFull();
     }
 }
 
+EditLog::Stats TextEditor::getHistoryStats() const {
+    return history.stats();
+}
+
 std::vector<size_t> TextEditor::find(const std::string& searchStr) const {
     std::vector<size_t> positions;
-    std::cout << "Inside find function" << std::endl;
-    size_t pos = 0;
-    while ((pos = text.to_string().find(searchStr, pos)) != std::string::npos) {
-        positions.push_back(pos);
-        pos += searchStr.length();
-    }
-    std::cout << "Positions: " << positions[0] << std::endl;
+    if (searchStr.empty()) return positions;
+
+    // Scan one leaf at a time, carrying over just enough of the previous
+    // chunk to catch matches that straddle a leaf boundary
+    std::string window;
+    size_t windowStart = 0;
+    size_t resumeAt = 0;
+    text.forEachChunk(0, text.length(), [&](const char* data, size_t count) {
+        window.append(data, count);
+        size_t pos = resumeAt;
+        while ((pos = window.find(searchStr, pos)) != std::string::npos) {
+            positions.push_back(windowStart + pos);
+            pos += searchStr.length();
+            resumeAt = pos;
+        }
+        size_t keep = searchStr.length() - 1;
+        size_t drop = window.length() > keep ? window.length() - keep : 0;
+        window.erase(0, drop);
+        windowStart += drop;
+        resumeAt = resumeAt > drop ? resumeAt - drop : 0;
+    });
     return positions;
 }
 
@@ -152,42 +158,227 @@ void TextEditor::replace(const std::string& searchStr, const std::string& replac
     auto positions = find(searchStr);
     for (auto it = positions.rbegin(); it != positions.rend(); ++it) {
         if (*it + searchStr.length() <= text.length()) {
-            executeCommand(std::make_unique<DeleteCommand>(*this, searchStr.length(), *it));
-            executeCommand(std::make_unique<InsertCommand>(*this, replaceStr, *it));
+            applyDelete(searchStr.length(), *it);
+            applyInsert(replaceStr, *it);
         }
     }
 }
 
+std::vector<size_t> TextEditor::markSearchHits(const std::string& searchStr) {
+    clearSearchHits();
+    std::vector<size_t> positions = find(searchStr);
+    for (size_t position : positions) {
+        searchHits.push_back(marks.create(position));
+    }
+    return positions;
+}
+
+bool TextEditor::nextSearchHit() {
+    if (searchHits.empty()) return false;
+    size_t position = cursor.getGlobalPosition();
+    auto next = std::upper_bound(searchHits.begin(), searchHits.end(), position,
+                                 [&](size_t pos, MarkSet::MarkId hit) { return pos < marks.offset(hit); });
+    if (next == searchHits.end()) next = searchHits.begin();
+    cursor.setGlobalPosition(text, marks.offset(*next));
+    return true;
+}
+
+void TextEditor::clearSearchHits() {
+    for (MarkSet::MarkId hit : searchHits) marks.remove(hit);
+    searchHits.clear();
+}
+
+void TextEditor::setBookmark(const std::string& name) {
+    auto it = bookmarks.find(name);
+    if (it != bookmarks.end()) {
+        marks.move(it->second, cursor.getGlobalPosition());
+    } else {
+        bookmarks[name] = marks.create(cursor.getGlobalPosition());
+    }
+}
+
+void TextEditor::jumpToBookmark(const std::string& name) {
+    auto it = bookmarks.find(name);
+    if (it == bookmarks.end()) throw std::runtime_error("No such bookmark: " + name);
+    cursor.setGlobalPosition(text, marks.offset(it->second));
+}
+
+std::vector<std::pair<std::string, size_t> > TextEditor::getBookmarks() const {
+    std::vector<std::pair<std::string, size_t> > result;
+    for (const auto& bookmark : bookmarks) {
+        result.emplace_back(bookmark.first, marks.offset(bookmark.second));
+    }
+    return result;
+}
+
 void TextEditor::loadFile(const std::string& filename) {
     std::ifstream file(filename);
     if (file) {
         std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-        std::cout << "File content read: " << content << std::endl;
-        text = Rope(content);
-        cursor = Cursor();
-        undoStack.clear();
-        redoStack.clear();
+        replaceDocument(Rope(content));
     } else {
         throw std::runtime_error("Unable to open file");
     }
 }
 
+void TextEditor::loadFile(const std::string& filename, LeafInternTable& interner) {
+    replaceDocument(Rope::fromFile(filename, interner));
+}
+
+void TextEditor::loadLargeFile(const std::string& filename, size_t cacheBudget) {
+    replaceDocument(Rope::fromFile(filename, cacheBudget));
+}
+
+void TextEditor::openAsync(const std::string& filename, size_t cacheBudget) {
+    // Open the file before anything is discarded, so a bad name leaves the
+    // current document alone
+    Rope newText = cacheBudget ? Rope::paged(cacheBudget) : Rope();
+    auto newLoader = std::make_unique<FileLoader>(filename, newText.leafCache());
+    replaceDocument(std::move(newText));
+    loader = std::move(newLoader);
+    loadTotalBytes = loader->totalBytes();
+    loader->waitForData();
+    pumpLoad();
+}
+
+bool TextEditor::pumpLoad() {
+    if (!loader) return false;
+
+    std::vector<std::shared_ptr<Leaf> > leaves = loader->takeLeaves();
+    if (!leaves.empty()) {
+        // New text always lands after the current end, even if the user has
+        // already typed there, so it is an insert on the last line
+        size_t lastLine = text.countLines() - 1;
+        size_t addedLines = 0;
+        for (const auto& leaf : leaves) {
+            addedLines += leaf->newlines();
+            loadedBytes += leaf->length();
+        }
+        text.append(leaves);
+        highlighter.linesChanged(lastLine, 0, addedLines);
+    }
+
+    if (loader->isDone()) {
+        bool failed = loader->hasFailed();
+        loader.reset();
+        if (failed) throw std::runtime_error("Error while reading file; document is incomplete");
+        return false;
+    }
+    return true;
+}
+
+void TextEditor::finishLoad() {
+    while (loader) {
+        loader->waitForData();
+        pumpLoad();
+    }
+}
+
+void TextEditor::cancelLoad() {
+    if (!loader) return;
+    loader->cancel();
+    finishLoad();
+}
+
+LoadProgress TextEditor::getLoadProgress() const {
+    return {loadedBytes, loadTotalBytes, loader != nullptr};
+}
+
+void TextEditor::replaceDocument(Rope newText) {
+    loader.reset();
+    loadedBytes = 0;
+    loadTotalBytes = 0;
+    journal.reset();
+    journalBasePath.clear();
+    text = std::move(newText);
+    if (text.isPaged()) {
+        highlighter.setTokenizer(nullptr, 0);
+    } else {
+        highlighter.reset(text.countLines());
+    }
+    cursor.setGlobalPosition(text, 0);
+    for (const auto& bookmark : bookmarks) marks.remove(bookmark.second);
+    bookmarks.clear();
+    clearSearchHits();
+    history.clear();
+    viewportStart = 0;
+}
+
+LeafCache::Stats TextEditor::getCacheStats() const {
+    return text.cacheStats();
+}
+
 void TextEditor::saveFile(const std::string& filename) const {
+    // Saving over the journaled base file is a checkpoint; anything else
+    // would leave the journal describing edits to the old contents
+    if (journal && filename == journalBasePath) {
+        writeCheckpoint();
+        return;
+    }
+    // The loader may still be reading the file being overwritten
+    if (loader) throw std::runtime_error("File is still loading; wait for it or cancel with 'n cancel'");
+    // Leaves that were never paged in still read from the file, so it can't
+    // be truncated under them; writing a new file and renaming it over the
+    // old one leaves the old inode readable through the open descriptor
+    if (text.isPaged()) {
+        EditJournal::replaceFileDurably(filename, text);
+        return;
+    }
     std::ofstream file(filename);
     if (file) {
-        file << text.to_string();
+        text.forEachChunk(0, text.length(), [&](const char* data, size_t count) { file.write(data, count); });
     } else {
         throw std::runtime_error("Unable to save file");
     }
 }
 
+void TextEditor::openJournaled(const std::string& filename) {
+    std::ifstream file(filename);
+    std::string content;
+    if (file) {
+        content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+    replaceDocument(Rope(content));
+
+    journal = std::make_unique<EditJournal>(filename + ".journal", checksum());
+    journalBasePath = filename;
+
+    // Replay edits that were journaled after the last checkpoint
+    for (const auto& entry : journal->takeRecoveredEntries()) {
+        if (entry.op == EditJournal::Op::Insert) {
+            text.insert(entry.position, entry.text);
+        } else {
+            text.remove(entry.position, entry.position + entry.count);
+        }
+    }
+    highlighter.reset(text.countLines());
+}
+
+void TextEditor::checkpoint() {
+    if (!journal) throw std::runtime_error("No journaled file is open");
+    writeCheckpoint();
+}
+
+void TextEditor::writeCheckpoint() const {
+    // A failed journal can't be synced, but a checkpoint writes the whole
+    // document and doesn't need its records
+    if (!journal->hasFailed()) journal->sync();
+    EditJournal::replaceFileDurably(journalBasePath, text);
+    journal->reset(checksum());
+}
+
+void TextEditor::checkpointIfJournalFull() {
+    if (journal && journal->size() >= kCheckpointThreshold) {
+        writeCheckpoint();
+    }
+}
+
 void TextEditor::setViewportHeight(size_t height) {
     viewportHeight = height;
 }
 
 void TextEditor::scrollDown() {
-    size_t totalLines = std::count(text.to_string().begin() , text.to_string().end(), '\n') + 1;
-    if (viewportStart + viewportHeight < totalLines) {
+    if (viewportStart + viewportHeight < text.countLines()) {
         ++viewportStart;
     }
 }
@@ -195,34 +386,78 @@ void TextEditor::scrollDown() {
 
 std::vector<std::string> TextEditor::getViewportContent() const {
     std::vector<std::string> lines;
-    size_t start = 0;
-    for (size_t i = 0; i < viewportStart; ++i) {
-        start = text.substring(start, text.length()).find('\n') + 1 + start;
-    }
-    for (size_t i = 0; i < viewportHeight; ++i) {
-        size_t end = text.substring(start, text.length()).find('\n');
-        if (end == std::string::npos){
-            lines.push_back(text.substring(start, text.length()));
-            break;
-        } else {
-            lines.push_back(text.substring(start, start + end));
-            start += end + 1;
+    if (viewportStart >= text.countLines() || viewportHeight == 0) return lines;
+
+    // Walk forward from the first visible line, touching only the leaves on screen
+    lines.emplace_back();
+    size_t start = text.lineStart(viewportStart);
+    size_t stride = 4096;
+    for (size_t pos = start; pos < text.length() && lines.size() <= viewportHeight; pos += stride) {
+        std::string chunk = text.substring(pos, std::min(pos + stride, text.length()));
+        for (char c : chunk) {
+            if (c != '\n') {
+                lines.back() += c;
+            } else if (lines.size() == viewportHeight) {
+                return lines;
+            } else {
+                lines.emplace_back();
+            }
         }
     }
     return lines;
 }
 
+void TextEditor::scrollTo(size_t line) {
+    viewportStart = std::min(line, text.countLines() - 1);
+}
+
+void TextEditor::setTokenizer(std::unique_ptr<Tokenizer> tokenizer) {
+    // The cache keeps a state for every line, which would undo the memory
+    // bound of large-file mode
+    if (tokenizer && text.isPaged()) {
+        throw std::runtime_error("Syntax highlighting is not available in large-file mode");
+    }
+    highlighter.setTokenizer(std::move(tokenizer), text.countLines());
+}
+
+std::vector<HighlightedLine> TextEditor::getHighlightedViewport() {
+    return highlighter.highlight(text, viewportStart, viewportHeight);
+}
+
+size_t TextEditor::takeLinesRelexed() {
+    return highlighter.takeLinesLexed();
+}
+
 size_t TextEditor::getCurrentLine() const {
-    return cursor.getRow();
+    return cursor.getRow(text);
 }
 
 size_t TextEditor::getCurrentColumn() const {
-    return cursor.getCol();
+    return cursor.getCol(text);
 }
 
 
 size_t TextEditor::getTotalLines() const {
-    return std::count(text.to_string().begin(), text.to_string().end(), '\n') + 1;
+    return text.countLines();
+}
+
+const Rope& TextEditor::getRope() const {
+    return text;
+}
+
+size_t TextEditor::getTextLength() const {
+    return text.length();
+}
+
+uint64_t TextEditor::checksum() const {
+    uint64_t hash = 14695981039346656037ULL;
+    text.forEachChunk(0, text.length(), [&](const char* data, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+    });
+    return hash;
 }
 
 void TextEditor::setWordWrap(bool enable) {
@@ -257,28 +492,47 @@ std::vector<std::string> TextEditor::getWrappedLines(size_t startLine, size_t en
     return wrappedLines;
 }
 
-void TextEditor::executeCommand(std::unique_ptr<Command> command) {
-    command->execute();
-    undoStack.push_back(std::move(command));
-    redoStack.clear();
+// Edits are recorded only once they went through, so a rejected one leaves
+// neither a record nor a truncated redo history behind
+void TextEditor::applyInsert(std::string_view str, size_t position) {
+    if (str.empty()) return;
+    insertTextAt(str, position);
+    history.recordInsert(position, str);
+    checkpointIfJournalFull();
 }
 
-// Helper methods for Command classes
+void TextEditor::applyDelete(size_t count, size_t position) {
+    if (count == 0) return;
+    // Ropes are persistent, so the old version still has the deleted text
+    Rope before = text;
+    deleteTextAt(count, position);
+    history.recordDelete(position, before, count);
+    checkpointIfJournalFull();
+}
 
-void TextEditor::insertTextAt(const std::string& str, size_t position) {
+// The range is checked and the journal gets its chance to refuse before the
+// rope is touched, so an edit is either applied everywhere or nowhere
+void TextEditor::insertTextAt(std::string_view str, size_t position) {
+    if (position > text.length()) throw std::out_of_range("Index out of range");
+    size_t line = text.lineOf(position);
+    if (journal) journal->recordInsert(position, str);
     text.insert(position, str);
-    cursor.setPosition(text, cursor.getRow(), cursor.getCol() + str.length());
+    highlighter.linesChanged(line, 0, std::count(str.begin(), str.end(), '\n'));
+    marks.textInserted(position, str.size());
+    cursor.rememberColumn(text);
 }
 
 void TextEditor::deleteTextAt(size_t count, size_t position) {
-    std::cout << "cursor before deleting the text: " << cursor.getCol() << std::endl;
+    if (position >= text.length() || count > text.length() - position) {
+        throw std::out_of_range("Invalid range");
+    }
+    size_t line = text.lineOf(position);
+    size_t removedLines = text.lineOf(position + count) - line;
+    if (journal) journal->recordDelete(position, count);
     text.remove(position, position + count);
-    std::cout << "TEXT AFTER REMOVING: " << text.to_string() << std::endl;
-    
-    size_t newCol = (cursor.getCol() > count) ? cursor.getCol() - count : 0;
-    std::cout << "CURSOR COL: " << newCol << std::endl;
-    
-    cursor.setPosition(text, cursor.getRow(), newCol);
+    highlighter.linesChanged(line, removedLines, 0);
+    marks.textRemoved(position, count);
+    cursor.rememberColumn(text);
 }
 
 std::string TextEditor::getTextAt(size_t position, size_t count) const {
@@ -3,31 +3,46 @@
 #define TEXT_EDITOR_H
 
 #include "rope.h"
+#include "marks.h"
 #include "cursor.h"
-#include "command.h"
+#include "edit_log.h"
+#include "highlighter.h"
+#include "file_loader.h"
 
+#include <map>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include <memory>
 #include <iostream>
 
-class Command;
+class EditJournal;
+class LeafInternTable;
 
 
 class TextEditor {
 private:
     Rope text;
+    MarkSet marks;
     Cursor cursor;
-    std::vector<std::unique_ptr<Command> > undoStack;
-    std::vector<std::unique_ptr<Command> > redoStack;
+    std::map<std::string, MarkSet::MarkId> bookmarks;
+    std::vector<MarkSet::MarkId> searchHits;  // in document order, which edits never change
+    EditLog history;
     size_t viewportStart;
     size_t viewportHeight;
     bool wordWrapEnabled;
-
+    HighlightCache highlighter;
+    std::unique_ptr<EditJournal> journal;
+    std::string journalBasePath;
+    std::unique_ptr<FileLoader> loader;
+    uint64_t loadedBytes;
+    uint64_t loadTotalBytes;
 
 public:
 
     TextEditor();
+    ~TextEditor();
 
     // basic editing operations
     void insertChar(char c);
@@ -47,43 +62,96 @@ public:
     // Undo/ Redo
     void undo();
     void redo();
+    EditLog::Stats getHistoryStats() const;
 
     // Search and Replace
     std::vector<size_t> find(const std::string& searchStr) const;
     void replace(const std::string& searchStr, const std::string& replaceStr);
+    // Like find(), but also keeps every match as a mark so the hits stay
+    // right while editing
+    std::vector<size_t> markSearchHits(const std::string& searchStr);
+    // Moves the cursor to the next hit after it, wrapping around
+    bool nextSearchHit();
+
+    // Bookmarks stay on the same text as the document changes around them
+    void setBookmark(const std::string& name);
+    void jumpToBookmark(const std::string& name);
+    std::vector<std::pair<std::string, size_t> > getBookmarks() const;
 
     // File operations
     void loadFile(const std::string& filename);
+    // Loads through an intern table so identical chunks are shared with other buffers
+    void loadFile(const std::string& filename, LeafInternTable& interner);
     void saveFile(const std::string& filename) const;
 
+    // Large-file mode: pages the file in on demand, keeping at most
+    // cacheBudget bytes of text in memory
+    void loadLargeFile(const std::string& filename, size_t cacheBudget);
+    LeafCache::Stats getCacheStats() const;
+
+    // Progressive loading: returns as soon as the first block is in and keeps
+    // reading in the background (paged when cacheBudget is non-zero). The
+    // document can be viewed and edited meanwhile; pumpLoad() appends whatever
+    // has arrived since the last call and returns false once the load is over.
+    void openAsync(const std::string& filename, size_t cacheBudget = 0);
+    bool pumpLoad();
+    // Blocks until the whole file is in
+    void finishLoad();
+    void cancelLoad();
+    LoadProgress getLoadProgress() const;
+
+    // Journaled editing: every edit is appended to <filename>.journal, and
+    // opening the same file again replays edits that were never checkpointed
+    void openJournaled(const std::string& filename);
+    void checkpoint();
+
     // Viewport operations
     void setViewportHeight(size_t height);
     // void scrollUp();
     void scrollDown();
+    void scrollTo(size_t line);
     std::vector<std::string> getViewportContent() const;
 
+    // Syntax highlighting, lexed incrementally; pass nullptr to turn it off.
+    // Not available for paged documents, and turned off when one is opened.
+    void setTokenizer(std::unique_ptr<Tokenizer> tokenizer);
+    std::vector<HighlightedLine> getHighlightedViewport();
+    size_t takeLinesRelexed();
+
     // Utility methods
     size_t getCurrentLine() const;
     size_t getCurrentColumn() const;
     size_t getTotalLines() const;
+    size_t getTextLength() const;
+    const Rope& getRope() const;
+    // FNV-1a hash of the document, used to compare replay results across builds
+    uint64_t checksum() const;
 
     // Wordwrapping
     void setWordWrap(bool enable);
     std::vector<std::string> getWrappedLines(size_t startLine, size_t endLine, size_t maxWidth) const;
 
-    void insertTextAt(const std::string& str, size_t position);
+    void insertTextAt(std::string_view str, size_t position);
     void deleteTextAt(size_t count, size_t position);
     std::string getTextAt(size_t position, size_t count) const;
 
     void debugPrint() const {
-        std::cout << "Text content: '" << text.to_string() << "'" << std::endl;
-        std::cout << "Cursor position: Row " << cursor.getRow() << ", Col " << cursor.getCol() << std::endl;
+        if (!text.isPaged()) {
+            std::cout << "Text content: '" << text.to_string() << "'" << std::endl;
+        }
+        std::cout << "Cursor position: Row " << cursor.getRow(text) << ", Col " << cursor.getCol(text) << std::endl;
         std::cout << "Text length: " << text.length() << std::endl;
     }
 private:
 
-    void executeCommand(std::unique_ptr<Command> command);
-    // Helper methods for Command classes
+    // Apply an edit and add it to the undo history
+    void applyInsert(std::string_view str, size_t position);
+    void applyDelete(size_t count, size_t position);
+    void replaceDocument(Rope newText);
+    void clearSearchHits();
+    void writeCheckpoint() const;
+    // Runs once an edit is fully applied and in the undo history
+    void checkpointIfJournalFull();
 };
 
 